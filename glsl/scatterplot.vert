@@ -1,15 +1,24 @@
-#version 400
-layout(location = 0) in vec2 in_position;
-layout(location = 1) in uint in_selection;
-
-out float yPosition;
-
-void main() {
-    gl_Position = vec4(in_position, 0.0, 1.0);
-    yPosition = in_position.y;
-    bool isSelected = (in_selection == 1);
-    if (isSelected)
-    	gl_PointSize = 15.f; 
-   	else
-   		gl_PointSize = 1.f;
-}
+#version 400
+layout(location = 0) in vec2 in_position;
+layout(location = 1) in uint in_selection;
+
+// Maps the measures, or their quantized values, to [-1,1]
+uniform vec2 positionScale_;
+uniform vec2 positionOffset_;
+
+out float yPosition;
+
+void main() {
+    vec2 position = in_position * positionScale_ + positionOffset_;
+    gl_Position = vec4(position, 0.0, 1.0);
+    // Brushed points (bit 2) are moved outside of the clip volume, so that they are not drawn
+    if ((in_selection & 2u) != 0u)
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+    yPosition = position.y;
+    // Linked points (bit 1) are drawn larger
+    bool isSelected = ((in_selection & 1u) != 0u);
+    if (isSelected)
+    	gl_PointSize = 15.f; 
+   	else
+   		gl_PointSize = 1.f;
+}
@@ -0,0 +1,54 @@
+#ifndef VRN_TNM_BITMAPINDEX_H
+#define VRN_TNM_BITMAPINDEX_H
+
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+namespace voreen {
+
+// A binned bitmap index over rows that have one value in each of several columns. The range of
+// the values is split into NumBins bins per column, and each bin keeps a bitmap of the rows whose
+// value falls into it. Selecting the rows with values in a range of a column then means OR-ing the
+// bitmaps of the bins inside the range and checking only the rows in the two bins at its ends
+// against the values; ranges on several columns are combined by AND-ing the results
+class BinnedBitmapIndex {
+public:
+	// The number of bins per column
+    static const int NumBins = 16;
+
+    BinnedBitmapIndex();
+
+	// Indexes nRows rows of nColumns values each, stored row after row, that lie within
+	// [minimum, maximum]. The values are not copied and have to outlive the index or the next build
+    void build(const float* values, size_t nRows, size_t nColumns, float minimum, float maximum);
+    void clear();
+
+    size_t numRows() const { return _nRows; }
+	// The number of 64 bit words in a bitmap over all rows
+    size_t numWords() const { return (_nRows + 63) / 64; }
+
+	// Fills selection with a bitmap of the rows whose value in each column c lies within
+	// [lower[c], upper[c]]. A value that is not a number only passes a range that covers all values
+    void select(const float* lower, const float* upper, std::vector<uint64_t>& selection) const;
+	// Like select, but only removes rows from a selection of numWords() words, so that the ranges of
+	// several indices over the same rows can be combined
+    void narrow(const float* lower, const float* upper, std::vector<uint64_t>& selection) const;
+
+private:
+	// The bin of the value; values outside of the range go to the first or last bin
+    int bin(float value) const;
+
+    const float* _values;
+    size_t _nRows;
+    size_t _nColumns;
+    float _minimum;
+    float _maximum;
+    float _binScale; // The number of bins per unit of the values
+    std::vector<uint64_t> _bitmaps; // The bitmap of bin b of column c starts at (c * NumBins + b) * numWords()
+};
+
+} // namespace
+
+#endif // VRN_TNM_BITMAPINDEX_H
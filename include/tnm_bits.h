@@ -0,0 +1,34 @@
+#ifndef VRN_TNM_BITS_H
+#define VRN_TNM_BITS_H
+
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace voreen {
+
+// The number of set bits in the word
+inline int countBits(uint64_t word) {
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// The index of the lowest set bit of the word, which must not be 0
+inline int lowestBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+} // namespace
+
+#endif // VRN_TNM_BITS_H
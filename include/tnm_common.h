@@ -3,6 +3,7 @@
 
 #include "voreen/core/ports/genericport.h"
 
+#include <stdint.h>
 #include <vector>
 
 namespace voreen {
@@ -13,7 +14,7 @@ const int NUM_DATA_VALUES = 4;
 
 
 struct VoxelDataItem { // There is one VoxelDataItem struct for each voxel in the dataset
-    unsigned int voxelIndex; // This is the index of the voxel from which the data was retrieved
+    uint64_t voxelIndex; // This is the index of the voxel from which the data was retrieved
     float dataValues[NUM_DATA_VALUES]; // The list of data values for this specific voxel
 };
 
@@ -1,26 +1,64 @@
 #ifndef VRN_TNM_DATAREDUCTION_H
 #define VRN_TNM_DATAREDUCTION_H
 
-#include "modules/tnm093/include/tnm_common.h"
+#include "voreen/core/properties/boolproperty.h"
+#include "voreen/core/properties/intproperty.h"
+#include "voreen/core/properties/optionproperty.h"
+#include "modules/tnm093/include/tnm_featurepyramid.h"
+#include "modules/tnm093/include/tnm_featuretable.h"
 
 namespace voreen {
 
-class TNMDataReduction : public Processor {
+class TNMDataReduction : public Processor, public FeatureConsumer {
 public:
+	// How the surviving rows are chosen
+    enum SamplingMode {
+        SamplingUniform = 0, // Every row is equally likely to survive
+        SamplingStratified = 1 // Rows with rare combinations of values are more likely to survive
+    };
+
     TNMDataReduction();
     Processor* create() const;
 
+    FeatureSet requestedFeatures() const;
+
     std::string getClassName() const    { return "TNMDataReduction"; }
     std::string getCategory() const     { return "tnm093"; }
     CodeState getCodeState() const      { return CODE_STATE_EXPERIMENTAL; }
 
 protected:
     void process();
+	// Keeps the processor invalid while not all rows of a progressive reduction were published
+    void afterProcess();
+
+private:
+	// Places the reduced table into the outport. If the input has a level-of-detail pyramid, the
+	// table gets one that is filtered from it, so the views can draw coarser levels of it, too
+    void publish(FeatureTable* table);
+	// Publishes the next, larger part of the rows in _progressiveSelection
+    void publishNextPart();
+	// Drops the selection of a progressive reduction, so that the next evaluation selects the rows again
+    void restartProgression();
 
-    DataPort _inport; // The incoming data
-    DataPort _outport; // Outgoing, filtered data
+    FeatureTablePort _inport; // The incoming data
+    FeatureTablePort _outport; // Outgoing, filtered data
 
     FloatProperty _percentage; // The percentage of how many values should be filtered away
+    BoolProperty _useTargetRows; // Keep _targetRows rows instead of dropping a percentage of them
+    IntProperty _targetRows; // The number of rows that are kept if _useTargetRows is set
+    IntOptionProperty _samplingMode; // Uniform or stratified sampling
+    IntProperty _binsPerMeasure; // The resolution of the grid the rows are binned on for stratified sampling
+    IntProperty _seed; // The seed of the random selection, for reproducible reductions
+    BoolProperty _progressive; // Publish a growing part of the rows on each evaluation; only for sorted tables in memory
+    IntProperty _initialRows; // The number of rows in the first part that is published
+
+	// The state of a progressive reduction
+    std::vector<uint64_t> _progressiveSelection; // All selected rows, as a bitmap over the rows of the source
+    const FeatureTable* _progressiveSource; // The table that holds the values of the selected rows
+    size_t _nSelected; // The number of selected rows; 0 if there is no progression
+    size_t _nPublished; // The number of rows that were asked for in the part that was published last
+
+    FeaturePyramid _pyramid; // The coarser levels of the table on the outport
 };
 
 
@@ -0,0 +1,30 @@
+#ifndef VRN_TNM_DATATOFEATURETABLE_H
+#define VRN_TNM_DATATOFEATURETABLE_H
+
+#include "voreen/core/processors/processor.h"
+#include "modules/tnm093/include/tnm_featuretable.h"
+
+namespace voreen {
+
+// Converts the row-oriented Data into a FeatureTable, so that processors that still produce a
+// DataPort can be connected to the processors that consume FeatureTables
+class TNMDataToFeatureTable : public Processor {
+public:
+    TNMDataToFeatureTable();
+    std::string getClassName() const   { return "TNMDataToFeatureTable"; }
+    std::string getCategory() const    { return "tnm093"               ; }
+    CodeState getCodeState() const     { return CODE_STATE_EXPERIMENTAL; }
+
+    Processor* create() const          { return new TNMDataToFeatureTable; }
+
+protected:
+    void process();
+
+private:
+    DataPort _inport; // The row-oriented input
+    FeatureTablePort _outport; // The columnar copy of the input
+};
+
+} // namespace
+
+#endif // VRN_TNM_DATATOFEATURETABLE_H
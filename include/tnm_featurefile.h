@@ -0,0 +1,151 @@
+#ifndef VRN_TNM_FEATUREFILE_H
+#define VRN_TNM_FEATUREFILE_H
+
+#include "modules/tnm093/include/tnm_featuretable.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace voreen {
+
+// The binary file format that FeatureTables are spilled and cached to. It mirrors the in-memory
+// layout of a FeatureTable: the header is followed by one column per measure, in the order of
+// the measures' indices, and the optional index column, and each of them starts on a multiple
+// of FeatureTable::ColumnAlignment. This allows the columns to be used straight from a memory
+// mapping of the file. Quantized tables store the FeatureTable::Quantization of each column in
+// a block between the header and the columns
+struct FeatureFileHeader {
+    static const uint32_t CurrentVersion = 5;
+	// The size of the header on disk; the first column starts right after it
+    static const size_t Size = 64;
+
+    char magic[4]; // "TNMF"
+    uint32_t version;
+    uint64_t numRows;
+    uint32_t numColumns;
+    uint32_t hasIndexColumn;
+    uint64_t cacheKey; // Identifies the input the table was computed from; 0 for spill files
+    uint64_t features; // The FeatureSet of the measures in the file
+    uint32_t storageFormat; // The FeatureTable::StorageFormat of the columns
+
+	// The size of a single value of a column in bytes
+    uint64_t valueSize() const;
+	// The byte offset of the quantization block; it is empty for tables of floats
+    uint64_t quantizationOffset() const;
+	// The byte offset of the column'th column in the file
+    uint64_t columnOffset(int column) const;
+	// The byte offset of the index column in the file
+    uint64_t indexOffset() const;
+	// The size of the whole file in bytes
+    uint64_t fileSize() const;
+
+	// Reads the header from the start of the file. Returns false if the file can't be read or is
+	// not a feature file of the current version
+    bool read(const std::string& path);
+};
+
+// Writes a FeatureTable file piece by piece, so that the whole table never has to be in memory
+class FeatureFileWriter {
+public:
+    FeatureFileWriter();
+    ~FeatureFileWriter();
+
+	// Creates the file for numRows rows and writes its header. The measures, the index column, the
+	// storage format and the quantization are taken from layout. Returns false if the file could
+	// not be created
+    bool open(const std::string& path, size_t numRows, const FeatureTable& layout, uint64_t cacheKey = 0);
+    void close();
+
+	// Writes the rows [firstRow, firstRow + table.size()) from the rows of the table, which has to
+	// contain the measures and have the storage format the file was opened with. Views can't be written
+    bool writeRows(size_t firstRow, const FeatureTable& table);
+
+private:
+    bool writeAt(uint64_t offset, const void* data, size_t bytes);
+
+    std::FILE* _file;
+    FeatureFileHeader _header;
+};
+
+// A read-only view of a whole file in memory. The pages are mapped copy-on-write, so writing to
+// the memory is allowed but never changes the file
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+	// Maps the whole file. Returns false if the file could not be opened or mapped
+    bool open(const std::string& path);
+    void close();
+
+    void* data() const { return _data; }
+    uint64_t size() const { return _size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    void* _data;
+    uint64_t _size;
+#ifdef _WIN32
+    void* _fileHandle;
+    void* _mappingHandle;
+#endif
+};
+
+// Iterates over a FeatureTable in chunks of rows. For a table of floats in memory the chunks point
+// directly into its columns; for a table that was spilled to disk each chunk is read from the file
+// into buffers of a fixed size, so the memory use doesn't depend on the size of the table.
+// Quantized values are restored to floats chunk by chunk
+class FeatureTableCursor {
+public:
+    static const size_t DefaultChunkSize = 1 << 16;
+
+    explicit FeatureTableCursor(const FeatureTable& table, size_t chunkSize = DefaultChunkSize);
+    ~FeatureTableCursor();
+
+	// Moves on to the next chunk. Returns false if there are no more rows
+    bool next();
+
+	// The first row of the current chunk in the table
+    size_t chunkBegin() const { return _chunkBegin; }
+	// The number of rows in the current chunk
+    size_t chunkSize() const { return _chunkSize; }
+
+	// The values of a measure for the rows of the current chunk; 0 if the table doesn't contain it
+    const float* column(int measure) const { return _columns[measure]; }
+	// The voxel index of row i of the current chunk
+    uint64_t voxelIndex(size_t i) const {
+        return _indices ? _indices[i] : static_cast<uint64_t>(_chunkBegin + i);
+    }
+
+private:
+    FeatureTableCursor(const FeatureTableCursor&);
+    FeatureTableCursor& operator=(const FeatureTableCursor&);
+
+    bool readChunk();
+    void dequantizeChunk();
+    void gatherChunk();
+
+    const FeatureTable& _table;
+    const size_t _maxChunkSize;
+    size_t _chunkBegin;
+    size_t _chunkSize;
+    const float* _columns[FeatureRegistry::MaxFeatures];
+    const uint64_t* _indices;
+
+    std::vector<float> _columnBuffer; // Used for spilled and quantized tables and views
+    FeatureRowIterator _rows; // The next row of a view
+
+	// Only used for spilled tables
+    std::FILE* _file;
+    FeatureFileHeader _header;
+    std::vector<uint16_t> _quantizedBuffer;
+    std::vector<uint64_t> _indexBuffer;
+};
+
+} // namespace
+
+#endif // VRN_TNM_FEATUREFILE_H
@@ -0,0 +1,80 @@
+#ifndef VRN_TNM_FEATUREKERNELS_H
+#define VRN_TNM_FEATUREKERNELS_H
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace voreen {
+
+// The largest neighbourhood radius the kernels support
+const int MaxNeighbourhoodRadius = 3;
+
+// The number of bins of the histogram the local entropy is computed from
+const int LocalEntropyBins = 16;
+
+// The inputs that are needed to compute the measures for one row of voxels. All pointers point
+// to the beginning of a row and are indexed by the x coordinate of the voxel
+struct FeatureRowInput {
+    const float* center; // The intensities of the row itself
+    const float* previousY; // The intensities of the row y-1 in the same plane
+    const float* nextY; // The intensities of the row y+1 in the same plane
+    const float* previousZ; // The intensities of the row y in the plane z-1
+    const float* nextZ; // The intensities of the row y in the plane z+1
+    const float* const* planes; // The row y in each of the planes z-radius, ..., z+radius
+    size_t rowStride; // The distance between two rows of a plane, so planes[i] +- rowStride are the rows y+-1
+    int radius; // The radius of the neighbourhood
+    const double* sum; // The sum of all intensities in the neighbourhood of each voxel
+    const double* sumSquared; // The sum of all squared intensities in the neighbourhood of each voxel
+    double inverseCount; // One over the number of voxels in the neighbourhood
+    float binScale; // Maps an intensity v to the histogram bin (v - binOffset) * binScale
+    float binOffset;
+};
+
+// A kernel computes one measure for the voxels [xBegin, xEnd) of a row and writes it to the
+// output row, which is indexed by the x coordinate of the voxel just like the input rows
+typedef void (*FeatureRowKernel)(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd);
+
+// The instruction set extensions the kernels below can make use of
+enum SimdLevel {
+    SimdLevelScalar,
+    SimdLevelSSE41,
+    SimdLevelAVX2
+};
+
+// Returns the best instruction set the kernels will use on this CPU. The CPU is queried only once
+SimdLevel featureKernelSimdLevel();
+
+// The kernels of the built-in measures. The gradient magnitude and the Laplacian are computed
+// using central differences, so the voxels xBegin-1 and xEnd have to be valid. Depending on
+// featureKernelSimdLevel() the average, the standard deviation and the gradient magnitude are
+// computed for 4 or 8 voxels at once; all code paths produce bit-identical results
+void computeIntensityRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd);
+void computeAverageRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd);
+void computeStdDeviationRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd);
+void computeGradientMagnitudeRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd);
+void computeLaplacianRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd);
+// The Shannon entropy (in bits) of the histogram of the (2*radius+1)^3 neighbourhood. The
+// histogram slides along the row, so only the two planes of voxels that enter and leave the
+// neighbourhood are touched per voxel
+void computeLocalEntropyRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd);
+
+// Converts n voxel values to float. This loop is simple enough to be vectorized by the compiler
+template <typename T>
+void convertToFloat(const T* source, float* target, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        target[i] = static_cast<float>(source[i]);
+}
+
+// The uint16 overload is vectorized explicitly, as uint16 is the most common voxel format
+void convertToFloat(const uint16_t* source, float* target, size_t n);
+
+// Computes the sum and the sum of squares of the (2*radius+1)^2 window around each voxel of an
+// xy-plane with separable running sums, so the cost per voxel does not depend on the radius.
+// Only the voxels that have a complete window, [radius, dim-radius) in both directions, are
+// written. rowSum and rowSumSquared are scratch buffers with the size of the plane
+void computeWindowSums(const float* plane, size_t dimX, size_t dimY, int radius,
+                       double* sum, double* sumSquared, double* rowSum, double* rowSumSquared);
+
+} // namespace
+
+#endif // VRN_TNM_FEATUREKERNELS_H
@@ -0,0 +1,93 @@
+#ifndef VRN_TNM_FEATUREPYRAMID_H
+#define VRN_TNM_FEATUREPYRAMID_H
+
+#include "modules/tnm093/include/tnm_featuretable.h"
+#include "tgt/vector.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace voreen {
+
+// A level-of-detail pyramid over the FeatureTable of a whole volume. Level 0 is the table itself,
+// each further level aggregates blocks of 2x2x2 rows of the level below, so it has about an
+// eighth of its rows. For every block a level stores the mean, the minimum and the maximum of
+// each measure. Each row of a level stands for the voxel at the lower corner of its block, which
+// is the voxel index in the index column of the level's mean table
+class FeaturePyramid {
+public:
+	// No level is made smaller than this many rows
+    static const size_t MinimumLevelRows = 4096;
+
+    FeaturePyramid();
+    ~FeaturePyramid();
+
+	// Builds the levels for the table, which has to hold one row per voxel of a volume with the
+	// dimensions, in memory and in the order of the voxels. The table is not copied and has to
+	// outlive the pyramid or the next build
+    void build(const FeatureTable& table, const tgt::svec3& dimensions, int nThreads);
+	// Builds the levels for a table that holds some of the voxels of the source's level 0, such as
+	// the output of a TNMDataReduction. Each level keeps the blocks of the source's level that
+	// contain at least one row of the table, as a view of that level, and levels that are not
+	// smaller than the one below are left out. The values are shared, so the source has to
+	// outlive the pyramid or the next build; the ranges are those of the source
+    void buildFiltered(const FeaturePyramid& source, const FeatureTable& table);
+    void clear();
+
+	// The number of levels, including level 0; 0 if the pyramid wasn't built
+    size_t numLevels() const { return _levels.size() + (_table ? 1 : 0); }
+
+	// The means of the measures in the blocks of the level; level 0 is the original table
+    const FeatureTable& level(size_t level) const;
+	// The smallest and largest values of the measures in the blocks of the level > 0. These
+	// tables have no index column; their rows are the rows of level(level)
+    const FeatureTable& minimum(size_t level) const { return _levels[level - 1]->minimum; }
+    const FeatureTable& maximum(size_t level) const { return _levels[level - 1]->maximum; }
+
+	// The smallest and largest value of the measure in the whole table
+    tgt::vec2 range(int measure) const { return _ranges[measure]; }
+
+private:
+    FeaturePyramid(const FeaturePyramid&);
+    FeaturePyramid& operator=(const FeaturePyramid&);
+
+    struct Level {
+        tgt::svec3 dimensions; // The number of blocks along each axis
+        FeatureTable mean;
+        FeatureTable minimum;
+        FeatureTable maximum;
+        std::vector<unsigned int> counts; // The number of voxels in each block; empty for filtered levels
+    };
+
+    const FeatureTable* _table; // Level 0
+    tgt::svec3 _dimensions; // The dimensions of the volume the voxel indices refer to
+    std::vector<Level*> _levels; // The levels 1, 2, ...
+    tgt::vec2 _ranges[FeatureRegistry::MaxFeatures];
+};
+
+// The wall clock time in milliseconds since some fixed point in the past
+double currentMilliseconds();
+
+// Chooses the level of a FeaturePyramid a view draws so that a frame fits into a time budget
+// while the user interacts. It keeps an estimate of the time per row from the frames it was told
+// about. Without interaction, or without a pyramid, the full table is drawn
+class LevelOfDetailSelector {
+public:
+    LevelOfDetailSelector();
+
+	// Returns the table to draw for the table on the inport
+    const FeatureTable& select(const FeatureTable& table, float budgetMilliseconds, bool interacting) const;
+
+	// Starts timing a frame
+    void beginFrame();
+	// Stops timing the frame, which drew nRows rows, and updates the estimate
+    void endFrame(size_t nRows);
+
+private:
+    double _millisecondsPerRow; // 0 until the first frame was timed
+    double _frameStart;
+};
+
+} // namespace
+
+#endif // VRN_TNM_FEATUREPYRAMID_H
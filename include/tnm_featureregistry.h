@@ -0,0 +1,113 @@
+#ifndef VRN_TNM_FEATUREREGISTRY_H
+#define VRN_TNM_FEATUREREGISTRY_H
+
+#include "voreen/core/ports/port.h"
+#include "voreen/core/properties/optionproperty.h"
+#include "modules/tnm093/include/tnm_featurekernels.h"
+#include "tgt/vector.h"
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace voreen {
+
+// A set of measures. Bit i stands for the measure with the index i in the FeatureRegistry
+typedef uint64_t FeatureSet;
+
+inline FeatureSet featureBit(int feature) {
+    return static_cast<FeatureSet>(1) << feature;
+}
+
+inline bool containsFeature(FeatureSet features, int feature) {
+    return (features & featureBit(feature)) != 0;
+}
+
+// The number of measures in the set
+inline int countFeatures(FeatureSet features) {
+    int n = 0;
+    for (; features != 0; features &= features - 1)
+        ++n;
+    return n;
+}
+
+// The indices of the measures that are always registered. The first four are the measures
+// VoxelDataItem::dataValues holds, in the same order
+enum BuiltInFeature {
+    FeatureIntensity = 0,
+    FeatureAverage,
+    FeatureStdDeviation,
+    FeatureGradientMagnitude,
+    FeatureLaplacian,
+    FeatureLocalEntropy
+};
+
+// The measures that are computed if no consumer asks for anything else
+const FeatureSet DefaultFeatures = 0xF;
+
+// Everything the extraction needs to know about a measure
+struct FeatureDescriptor {
+	// The parts of the FeatureRowInput that are only prepared if a measure needs them
+    enum Requirement {
+        RequiresWindowSums = 1 << 0, // sum, sumSquared and inverseCount
+        RequiresIntensityRange = 1 << 1 // binScale and binOffset
+    };
+
+    const char* name; // The name that is shown in the GUI
+    FeatureRowKernel kernel; // Computes the measure for a row of voxels
+	// The range of values the measure can take for a volume whose intensities lie in intensityRange
+	// and a neighbourhood of the given radius
+    tgt::vec2 (*range)(const tgt::vec2& intensityRange, int radius);
+    int requirements; // A combination of the Requirement flags
+};
+
+// The list of all measures that can be extracted from a volume. The built-in measures are
+// registered when the registry is created; further measures can be added with registerFeature
+class FeatureRegistry {
+public:
+	// FeatureSet has one bit per measure
+    static const int MaxFeatures = 64;
+
+    static FeatureRegistry& instance();
+
+	// Adds a measure and returns its index, or -1 if there are already MaxFeatures measures
+    int registerFeature(const FeatureDescriptor& descriptor);
+
+    int numFeatures() const { return static_cast<int>(_features.size()); }
+    const FeatureDescriptor& feature(int index) const { return _features[index]; }
+
+	// The combined requirements of all measures in the set
+    int requirements(FeatureSet features) const;
+
+	// Adds one option per measure to the property. The key of an option is the measure's index
+    void addOptions(IntOptionProperty& property) const;
+
+private:
+    FeatureRegistry();
+
+    std::vector<FeatureDescriptor> _features;
+};
+
+// Implemented by the processors that read a FeatureTable from their inport. The processor
+// producing the table asks its consumers which measures they need and only computes those
+class FeatureConsumer {
+public:
+    virtual ~FeatureConsumer() {}
+
+	// The measures this processor needs in the table on its inport
+    virtual FeatureSet requestedFeatures() const = 0;
+};
+
+// The union of the measures that the processors connected to the outport request. Processors
+// that are not FeatureConsumers get the DefaultFeatures, as does an unconnected port
+FeatureSet requestedFeatures(const Port& outport);
+
+// Makes the processors that produce the table on the inport compute it again. Consumers call
+// this when they need a measure their current table doesn't contain. Processors that pass on
+// FeatureTables, like TNMDataReduction, are invalidated as well, up to the first processor
+// that doesn't read a FeatureTable
+void invalidateFeatureProducers(const Port& inport);
+
+} // namespace
+
+#endif // VRN_TNM_FEATUREREGISTRY_H
@@ -0,0 +1,276 @@
+#ifndef VRN_TNM_FEATURETABLE_H
+#define VRN_TNM_FEATURETABLE_H
+
+#include "modules/tnm093/include/tnm_bits.h"
+#include "modules/tnm093/include/tnm_common.h"
+#include "modules/tnm093/include/tnm_featureregistry.h"
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+namespace voreen {
+
+class FeaturePyramid;
+class MappedFile;
+
+// The columnar counterpart of Data. Each measure is stored in its own contiguous array, so that
+// a pass over a single measure only touches the memory of that measure. The values are either
+// stored as floats or quantized to 16 bit integers, which halves the memory of the table. All columns
+// share a single allocation and start on a cache line boundary. A table only contains the
+// columns of the measures that were requested; they are addressed by their FeatureRegistry index.
+// The voxel index of each row is either stored in an optional index column, or, if there is
+// no index column, row i belongs to the voxel with the index i.
+// A table that is too large for the memory can be spilled to a file instead (see
+// tnm_featurefile.h). Its columns are then not accessible directly and have to be read with a
+// FeatureTableCursor. A table can also be memory-mapped from a cache file, in which case the
+// columns point into the mapping.
+// Finally, a table can be a view of some rows of another table, the source. A view only stores a
+// bitmap of the source rows it contains and has no columns of its own; its values are read from
+// the source's columns, which is what storage() returns. Row i of a view is the i-th selected row
+// of the source, so the rows keep the order of the source
+class FeatureTable {
+public:
+    // The alignment of each column in bytes
+    static const size_t ColumnAlignment = 64;
+
+	// How the values of all measures in the table are stored
+    enum StorageFormat {
+        StorageFloat32 = 0, // One float per value; the columns are accessed with column()
+        StorageUInt16 = 1 // One quantized 16 bit value; the columns are accessed with quantizedColumn()
+    };
+
+	// The mapping of the quantized values of a column to the measure: value = offset + scale * q
+    struct Quantization {
+        static const uint16_t MaxValue = 65535;
+
+        float offset;
+        float scale;
+
+		// Maps [minimum, maximum] onto the whole range of the quantized values
+        static Quantization fromRange(float minimum, float maximum);
+
+		// The quantized value that is closest to the value; values outside of the range are clamped
+        uint16_t encode(float value) const {
+            const float q = (value - offset) / scale + 0.5f;
+			// Written such that NaN ends up at 0, too
+            if (!(q >= 1.f))
+                return 0;
+            if (q >= MaxValue)
+                return MaxValue;
+            return static_cast<uint16_t>(q);
+        }
+        float decode(uint16_t q) const { return offset + scale * q; }
+    };
+
+    FeatureTable();
+    FeatureTable(size_t nRows, bool hasIndexColumn, FeatureSet features, StorageFormat format = StorageFloat32);
+    ~FeatureTable();
+
+	// Changes the number of rows, the measures, whether there is an index column and the storage
+	// format. The memory of the columns is reused if it is large enough, so resizing a table to
+	// its current shape costs nothing. The contents of the table are undefined afterwards and have
+	// to be written. The quantization of all columns is reset to the identity
+    void resize(size_t nRows, bool hasIndexColumn, FeatureSet features, StorageFormat format = StorageFloat32);
+
+	// Releases the columns and refers to the table of nRows rows in the spill file instead. The
+	// measures, the index column, the storage format and the quantization are those of layout,
+	// which is the table the file was written from
+    void attachSpillFile(const std::string& path, size_t nRows, const FeatureTable& layout);
+
+	// Releases the columns and maps them from the cache file instead, without reading or copying
+	// them. Returns false, and leaves the table as it was, if the file doesn't exist, was written
+	// for a different cache key or storage format or lacks one of the required measures
+    bool mapCacheFile(const std::string& path, uint64_t cacheKey, FeatureSet requiredFeatures,
+                      StorageFormat format = StorageFloat32);
+
+	// Releases the columns and turns the table into a view of the rows of source whose bits are set
+	// in selection, which is taken over and left empty. The source isn't copied and has to outlive
+	// the view; in a network it is the table on the inport of the view's producer, which processes
+	// again whenever that table changes. The source must be resident and must not be a view itself
+    void attachView(const FeatureTable& source, std::vector<uint64_t>& selection);
+
+	// Returns whether the table is a view of another table
+    bool isView() const { return _viewSource != 0; }
+	// The table whose columns hold the values of this table: the source for views, the table itself otherwise
+    const FeatureTable& storage() const { return _viewSource ? *_viewSource : *this; }
+	// The bitmap of the source rows in the view, 64 rows per word. Empty for tables that are not views
+    const std::vector<uint64_t>& selection() const { return _selection; }
+	// The row of storage() that holds the values of the row. This takes a search for views, so
+	// loops over all rows should use a FeatureRowIterator instead
+    size_t storageRow(size_t row) const { return _viewSource ? selectedRow(row) : row; }
+
+	// Returns whether the columns are in memory. Otherwise they are in the spill file
+    bool isResident() const { return _spillFile.empty(); }
+	// The file the table was spilled to, or an empty string for tables in memory
+    const std::string& spillFile() const { return _spillFile; }
+
+	// The number of rows in the table
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+	// The measures stored in the table
+    FeatureSet features() const { return _features; }
+    bool hasFeature(int measure) const { return containsFeature(_features, measure); }
+	// The number of measures stored in the table
+    int numColumns() const { return countFeatures(_features); }
+
+	// How the values are stored
+    StorageFormat storageFormat() const { return _format; }
+    bool isQuantized() const { return _format == StorageUInt16; }
+	// The size of a single value in bytes
+    size_t valueSize() const { return isQuantized() ? sizeof(uint16_t) : sizeof(float); }
+
+	// The contiguous array of all values of the measure; 0 if the table doesn't contain it, is
+	// quantized or is a view
+    float* column(int measure) { return isQuantized() ? 0 : static_cast<float*>(_columns[measure]); }
+    const float* column(int measure) const { return isQuantized() ? 0 : static_cast<const float*>(_columns[measure]); }
+
+	// The contiguous array of all quantized values of the measure; 0 if the table doesn't contain
+	// it or stores floats
+    uint16_t* quantizedColumn(int measure) { return isQuantized() ? static_cast<uint16_t*>(_columns[measure]) : 0; }
+    const uint16_t* quantizedColumn(int measure) const {
+        return isQuantized() ? static_cast<const uint16_t*>(_columns[measure]) : 0;
+    }
+	// The memory of the column, whatever the storage format is; valueSize() bytes per row
+    void* columnData(int measure) { return _columns[measure]; }
+    const void* columnData(int measure) const { return _columns[measure]; }
+
+	// The mapping of the quantized values of the measure. Only meaningful for quantized tables
+    const Quantization& quantization(int measure) const { return _quantization[measure]; }
+    void setQuantization(int measure, const Quantization& quantization) { _quantization[measure] = quantization; }
+
+	// The value of a single measure in a single row
+    float value(size_t row, int measure) const {
+        if (_viewSource)
+            return _viewSource->value(selectedRow(row), measure);
+        if (isQuantized())
+            return _quantization[measure].decode(static_cast<const uint16_t*>(_columns[measure])[row]);
+        return static_cast<const float*>(_columns[measure])[row];
+    }
+
+    bool hasIndexColumn() const { return _hasIndexColumn; }
+	// The index column; 0 if the table doesn't have one
+    uint64_t* indexColumn() { return _indices; }
+    const uint64_t* indexColumn() const { return _indices; }
+
+	// The index of the voxel the row belongs to
+    uint64_t voxelIndex(size_t row) const {
+        if (_viewSource)
+            return _viewSource->voxelIndex(selectedRow(row));
+        return _indices ? _indices[row] : static_cast<uint64_t>(row);
+    }
+
+	// Returns whether the rows are ordered by their voxel indices. This is always the
+	// case for tables without an index column and for views of sorted tables; otherwise
+	// the producer has to guarantee it
+    bool isSortedByVoxelIndex() const {
+        if (_viewSource)
+            return _viewSource->isSortedByVoxelIndex();
+        return !_hasIndexColumn || _sortedByVoxelIndex;
+    }
+	// Lets the producer of a table with an index column state that its rows are sorted
+    void setSortedByVoxelIndex(bool sorted) { _sortedByVoxelIndex = sorted; }
+
+	// The level-of-detail pyramid built over this table, or 0. The pyramid is owned by the producer
+	// of the table and is dropped whenever the table changes
+    const FeaturePyramid* pyramid() const { return _pyramid; }
+    void setPyramid(const FeaturePyramid* pyramid) { _pyramid = pyramid; }
+
+	// Creates a table with the contents of data, which holds the DefaultFeatures. The index column
+	// is only created if the voxel indices are not simply 0, 1, 2, ...
+    static FeatureTable* createFromData(const Data& data);
+	// Creates a row-oriented copy of this table; this works for spilled and quantized tables, too.
+	// Measures beyond the DefaultFeatures are dropped, missing ones are zero
+    Data* createData() const;
+
+private:
+	// Copying a table is expensive and would happen by accident too easily
+    FeatureTable(const FeatureTable&);
+    FeatureTable& operator=(const FeatureTable&);
+
+	// The number of words of the selection that share an entry of _selectionRanks
+    static const size_t RankBlockWords = 8;
+
+    void release();
+	// The source row of the row of a view
+    size_t selectedRow(size_t row) const;
+
+    size_t _size; // The number of rows
+    FeatureSet _features; // The measures that have a column
+    StorageFormat _format;
+    bool _hasIndexColumn;
+    bool _sortedByVoxelIndex; // Only meaningful if there is an index column
+    std::string _spillFile; // The file the columns are stored in for tables that are not resident
+    void* _storage; // The single allocation that holds all columns
+    size_t _capacity; // The size of _storage in bytes
+    MappedFile* _mappedFile; // The mapping the columns point into, if the table was mapped
+    const FeaturePyramid* _pyramid;
+    void* _columns[FeatureRegistry::MaxFeatures]; // The start of each measure's column within _storage or the mapping
+    Quantization _quantization[FeatureRegistry::MaxFeatures]; // The mapping of each measure's quantized values
+    uint64_t* _indices; // The start of the index column within _storage or the mapping, or 0
+
+    const FeatureTable* _viewSource; // The table this table is a view of, or 0
+    std::vector<uint64_t> _selection; // The bitmap of the source rows in the view
+    std::vector<size_t> _selectionRanks; // The number of selected rows before each block of RankBlockWords words
+};
+
+// Walks over the rows of a table in order and provides, for each row, the row of the table's
+// storage() that holds its values. For views it jumps from one set bit of the selection to the
+// next, which makes a pass over a view as cheap as over a table of its own
+class FeatureRowIterator {
+public:
+    explicit FeatureRowIterator(const FeatureTable& table);
+
+    bool atEnd() const { return _row >= _size; }
+    void next();
+
+	// The row of the table
+    size_t row() const { return _row; }
+	// The row of the table's storage()
+    size_t storageRow() const { return _storageRow; }
+
+private:
+    void findSetBit();
+
+    const uint64_t* _words; // The selection of a view, or 0
+    size_t _word; // The word of the selection that contains the current row
+    uint64_t _bits; // The bits of that word that have not been visited yet
+    size_t _size;
+    size_t _row;
+    size_t _storageRow;
+};
+
+// Finds the row of a table that belongs to a voxel. Brushing and linking name voxels, so this is
+// how their consumers get from the voxels back to the rows they draw
+class VoxelRowMap {
+public:
+    VoxelRowMap();
+
+	// Maps the voxels of the table to its rows. Without an index column, and for a table that
+	// isn't a view, the row is the voxel and nothing has to be stored
+    void build(const FeatureTable& table);
+    void clear();
+
+	// The row of the voxel, or -1 if the table has no row for it
+    long row(uint64_t voxel) const;
+
+private:
+    size_t _nRows;
+    std::vector<std::pair<uint64_t, size_t> > _rows; // The row of each voxel, sorted by voxel; empty if row and voxel are the same
+};
+
+// Quantizes the n values into target
+void quantizeValues(const float* values, uint16_t* target, size_t n, const FeatureTable::Quantization& quantization);
+// Restores the n quantized values into target
+void dequantizeValues(const uint16_t* values, float* target, size_t n, const FeatureTable::Quantization& quantization);
+
+// This port will be added to processors in order to exchange FeatureTable objects
+typedef GenericPort<FeatureTable> FeatureTablePort;
+
+} // namespace
+
+#endif // VRN_TNM_FEATURETABLE_H
@@ -0,0 +1,30 @@
+#ifndef VRN_TNM_FEATURETABLETODATA_H
+#define VRN_TNM_FEATURETABLETODATA_H
+
+#include "voreen/core/processors/processor.h"
+#include "modules/tnm093/include/tnm_featuretable.h"
+
+namespace voreen {
+
+// Converts a FeatureTable back into the row-oriented Data, so that processors that still consume
+// a DataPort can be connected to the processors that produce FeatureTables
+class TNMFeatureTableToData : public Processor {
+public:
+    TNMFeatureTableToData();
+    std::string getClassName() const   { return "TNMFeatureTableToData"; }
+    std::string getCategory() const    { return "tnm093"               ; }
+    CodeState getCodeState() const     { return CODE_STATE_EXPERIMENTAL; }
+
+    Processor* create() const          { return new TNMFeatureTableToData; }
+
+protected:
+    void process();
+
+private:
+    FeatureTablePort _inport; // The columnar input
+    DataPort _outport; // The row-oriented copy of the input
+};
+
+} // namespace
+
+#endif // VRN_TNM_FEATURETABLETODATA_H
@@ -0,0 +1,106 @@
+#ifndef VRN_TNM_INDEXSET_H
+#define VRN_TNM_INDEXSET_H
+
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+namespace voreen {
+
+// A compressed set of 64 bit indices in the manner of a roaring bitmap. The indices are split by
+// their upper 48 bits into chunks of 65536 indices; a chunk with few indices stores them as a
+// sorted array of their lower 16 bits, a chunk with many as a bitmap of 8 KB. Half of the voxels
+// of a volume thus take about one bit each, instead of the 40 bytes per index of a std::set.
+// The chunks are shared between copies of a set and are only copied when one of the copies
+// changes them, so passing a set into a property is cheap. The sharing is not synchronized, so
+// all copies have to be used from the same thread
+class IndexSet {
+public:
+    IndexSet();
+    IndexSet(const IndexSet& other);
+    IndexSet& operator=(const IndexSet& other);
+    ~IndexSet();
+
+    bool empty() const { return _chunks.empty(); }
+	// The number of indices in the set
+    size_t size() const;
+	// The number of bytes used by the chunks, whether they are shared or not
+    size_t memoryUsage() const;
+
+    bool contains(uint64_t index) const;
+    void insert(uint64_t index);
+    void erase(uint64_t index);
+    void clear();
+
+	// The union, intersection and difference with another set
+    IndexSet& operator|=(const IndexSet& other);
+    IndexSet& operator&=(const IndexSet& other);
+    IndexSet& operator-=(const IndexSet& other);
+
+	// The indices that were added to and removed from previous to arrive at this set. Chunks that
+	// this set still shares with previous are skipped, so for a set that was copied from previous
+	// and then changed, the cost depends on the changed chunks and not on the size of the set
+    void changesSince(const IndexSet& previous, IndexSet& added, IndexSet& removed) const;
+
+    bool operator==(const IndexSet& other) const;
+    bool operator!=(const IndexSet& other) const { return !(*this == other); }
+
+	// Walks over the indices in ascending order
+    class const_iterator {
+    public:
+        const_iterator() : _set(0), _chunk(0), _position(0) {}
+
+        uint64_t operator*() const;
+        const_iterator& operator++();
+        bool operator==(const const_iterator& other) const { return _chunk == other._chunk && _position == other._position; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class IndexSet;
+        const_iterator(const IndexSet* set, size_t chunk);
+		// Moves to the next set bit of a bitmap chunk, starting at _position
+        void findSetBit();
+
+        const IndexSet* _set;
+        size_t _chunk; // The chunk of the current index
+        size_t _position; // The position within the array, or the bit within the bitmap, of the chunk
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, _chunks.size()); }
+
+private:
+	// A chunk with more indices than this is stored as a bitmap
+    static const size_t MaxArraySize = 4096;
+	// The number of 64 bit words of a bitmap chunk
+    static const size_t BitmapWords = 65536 / 64;
+
+    struct Chunk {
+        int references; // The number of sets that share the chunk
+        uint64_t key; // The upper 48 bits of all indices in the chunk
+        size_t count; // The number of indices in the chunk
+        std::vector<uint16_t> values; // The sorted lower 16 bits of the indices, for array chunks
+        std::vector<uint64_t> words; // The bitmap of the lower 16 bits, for bitmap chunks; empty otherwise
+
+        bool isBitmap() const { return !words.empty(); }
+        bool contains(uint16_t value) const;
+		// Switches to the representation that suits the count
+        void normalize();
+    };
+
+	// Returns the position of the chunk with the key, or the position where it would have to be inserted
+    size_t findChunk(uint64_t key) const;
+	// Makes sure that the chunk at the position is not shared, so that it can be changed
+    Chunk* mutableChunk(size_t position);
+	// Drops this set's reference to the chunk
+    static void release(Chunk* chunk);
+	// Combines two chunks with the same key; 0 if the result is empty
+    static Chunk* combine(const Chunk& first, const Chunk& second, int operation);
+
+    std::vector<Chunk*> _chunks; // Sorted by their keys; empty chunks are removed
+};
+
+} // namespace
+
+#endif // VRN_TNM_INDEXSET_H
@@ -2,8 +2,17 @@
 #define VRN_TNM_PARALLELCOORDINATES_H
 
 #include "voreen/core/processors/renderprocessor.h"
+#include "voreen/core/properties/boolproperty.h"
 #include "voreen/core/properties/eventproperty.h"
-#include "modules/tnm093/include/tnm_common.h"
+#include "voreen/core/properties/floatproperty.h"
+#include "voreen/core/properties/intproperty.h"
+#include "voreen/core/properties/optionproperty.h"
+#include "voreen/core/properties/stringproperty.h"
+#include "modules/tnm093/include/tnm_bitmapindex.h"
+#include "modules/tnm093/include/tnm_featurepyramid.h"
+#include "modules/tnm093/include/tnm_featureregistry.h"
+#include "modules/tnm093/include/tnm_featuretable.h"
+#include "modules/tnm093/include/tnm_segmentindex.h"
 #include "modules/tnm093/include/indexproperty.h"
 #include "tgt/vector.h"
 #include <utility>
@@ -11,8 +20,15 @@
 
 namespace voreen {
 
-class TNMParallelCoordinates : public RenderProcessor {
+class TNMParallelCoordinates : public RenderProcessor, public FeatureConsumer {
 public:
+	// How the rows are drawn
+    enum LineMode {
+        LineModeLines = 0, // One line per row
+        LineModeDensity = 1, // The number of rows between each pair of bins on neighbouring axes
+        LineModeAutomatic = 2 // Lines for small tables, the density for large ones
+    };
+
     TNMParallelCoordinates();
     ~TNMParallelCoordinates();
     std::string getClassName() const   { return "TNMParallelCoordinates";   }
@@ -21,13 +37,62 @@ public:
 
     Processor* create() const          { return new TNMParallelCoordinates; }
 
+	void deinitialize() throw (tgt::Exception);
+
+	// The measures that are shown. Measures registered after this processor was created have no
+	// show property; they get an axis if the table contains them, because another consumer asked for them
+    FeatureSet requestedFeatures() const;
+
 protected:
+	// Asks for the table to be computed again if it lacks the measure of an axis
+    void axisChanged();
+
+	// The measures that get an axis for the table, from left to right
+    std::vector<int> axisMeasures(const FeatureTable& data) const;
+	// Moves the axis at position from to position to, shifting the axes in between
+    void moveAxis(size_t from, size_t to);
+	// Restores the order of the axes from _savedAxisOrder, e.g. after the workspace was loaded
+    void axisOrderChanged();
+
 	// This method gets called during each run of the rendering loop
     void process();
 
+	// Fills the vertex buffers of the lines if the table or the axes changed, and the index
+	// buffers if the brushing or linking changed
+    void updateLines();
+	// Drops everything that was computed for the previous table and sizes the buffers for the new one
+    void resetLines(const FeatureTable& data);
+	// Moves the lines to the axes with the measures. Only the parts between axes whose measures
+	// changed are computed again
+    void updateAxes(const FeatureTable& data, const std::vector<int>& measures);
+    void updateLineIndices(const FeatureTable& data);
+
+	// The normalized values of the measure for each row, which are computed together with the
+	// index used for brushing when the measure first gets an axis
+    const std::vector<float>& measureValues(const FeatureTable& data, int measure);
+	// The normalized values on each axis, from left to right
+    std::vector<const float*> axisValues() const;
+
+	// Returns whether the density is drawn instead of the lines for the table
+    bool drawsDensity(const FeatureTable& data) const;
+	// Counts the visible rows in the bins of each pair of neighbouring axes
+    void buildDensity();
+	// Counts them for the listed pairs only; pair p lies between the axes p and p + 1
+    void countDensity(const std::vector<size_t>& pairs);
+	// Adds the row to, or removes it from, the counts of its bins; values are those of axisValues()
+    void updateDensity(const std::vector<const float*>& values, size_t row, bool add);
+	// Makes the index buffers be filled again, as the line mode changed
+    void lineModeChanged();
+
 	// Render the lines for the parallel coordinates plot
     void renderLines(bool picking = false);
 
+	// Render the rows as bands between the bins of neighbouring axes, colored by their count
+    void renderDensity();
+
+	// Render a histogram of the measure next to each axis
+    void renderHistograms();
+
 	// Render the lines with picking information included in the color
 	void renderLinesPicking();
 
@@ -38,14 +103,32 @@ protected:
 	// included in the color
     void renderHandlesPicking();
 
+	// Render the line of the row under the cursor on top of the others
+    void renderHoveredLine();
+
+	// Returns the visible row whose line passes closest to the point in [-1,1], or -1 if none
+	// is close enough. Only available if the lines are picked on the CPU
+    long pickLine(const tgt::vec2& normalizedDeviceCoordinates) const;
+
+	// Reads the texel at the position from the picking texture of the last rendering
+    tgt::vec4 readPickingTexel(const tgt::ivec2& position);
+
 	// The callback method that gets called when a mouse button was clicked on the rendering
     void handleMouseClick(tgt::MouseEvent* e);
 
 	// The callback method that gets called when the mouse is moved across the rendering
     void handleMouseMove(tgt::MouseEvent* e);
 
+	// Moves the dragged handle to the latest position it was dragged to
+    void applyPendingMove();
+	// Reports the time from the first handle move of the frame until the frame was rendered
+    void updateLatency();
+
 	// The callback method that gets called when the mouse button is released
     void handleMouseRelease(tgt::MouseEvent* e);
+
+	// The callback method that gets called when the mouse is moved without a button pressed
+    void handleMouseHover(tgt::MouseEvent* e);
   
     void renderAxisLines();
     // This class stores and renders a single handle
@@ -94,7 +177,7 @@ protected:
 
 private:
 	// The inport supplying the data to this processor
-    DataPort _inport;
+    FeatureTablePort _inport;
 
 	// The outport that will contain the rendering meant for the user
     RenderPort _outport;
@@ -103,25 +186,97 @@ private:
 	// and which will be queried in the mouse callbacks
     RenderPort _privatePort;
 
+	// Whether the measure with the same index in the FeatureRegistry gets an axis
+    std::vector<BoolProperty*> _showMeasures;
+	// The order of the axes: the indices of all measures, from left to right. Measures that are not
+	// in the table or are hidden are skipped
+    std::vector<int> _axisOrder;
+	// The indices in _axisOrder, separated by spaces, so that the order is saved with the workspace
+    StringProperty _savedAxisOrder;
+
 	// The event that registers the click event
     EventProperty<TNMParallelCoordinates>* _mouseClickEvent;
 	// The event that registers the move event
     EventProperty<TNMParallelCoordinates>* _mouseMoveEvent;
 	// The event that registeres the release event
     EventProperty<TNMParallelCoordinates>* _mouseReleaseEvent;
+	// The event that registers moves without a pressed button
+    EventProperty<TNMParallelCoordinates>* _mouseHoverEvent;
 
-	// A list of all the handles that are registerd
+	// A list of all the handles that are registerd; the handles 2*m and 2*m+1 are the top and bottom
+	// handle of the axis of measure m, and keep their place when the axes are reordered
     std::vector<AxisHandle> _handles;
 	// The id of the currently picked handle; necessary in the interaction between the
 	// mouseClick and the mouseMove methods to store the ID that was clicked
     int _pickedHandle;
+	// The position of the axis that is dragged to a new place, or -1, and where it was dragged to
+    int _draggedAxis;
+    float _draggedAxisPosition;
 
 	//
 	IndexProperty _brushingIndices;  // A list of voxel indices that should be ignored in the rendering
 	IndexProperty _linkingIndices; // A list of voxel indices that should be enhanced during rendering
 
-	std::set<unsigned int> _brushingList; // The internal storage for the list of ignored voxels
-	std::set<unsigned int> _linkingList; // The internal storage for the list of selected voxels
+	IndexSet _brushingList; // The internal storage for the list of ignored voxels
+	IndexSet _linkingList; // The internal storage for the list of selected voxels
+
+	FloatProperty _frameBudget; // The time a frame may take while a handle is dragged, in milliseconds
+	BoolProperty _interacting; // Set while a handle is dragged; linked to the other views
+	LevelOfDetailSelector _levelOfDetail; // Picks the level of the pyramid that fits the budget
+	FloatProperty _latency; // The time from the first handle move of the last frame until it was rendered, in milliseconds
+	FloatProperty _averageLatency; // _latency smoothed over the last frames
+	IntProperty _mergedMoves; // The number of handle moves that were merged into the last frame
+	BoolProperty _showHistograms; // Show the distribution of the values next to each axis
+	IntOptionProperty _lineMode; // Draw the lines, the density, or choose by the size of the table
+	BoolProperty _cpuPicking; // Pick and hover the lines with a LineSegmentIndex instead of rendering them for picking
+
+	// The statistics of a measure of the table on the inport
+	struct MeasureStatistics {
+		MeasureStatistics() : hasRange(false), minimum(0.f), maximum(0.f) {}
+
+		bool hasRange; // Whether minimum and maximum were computed
+		float minimum;
+		float maximum;
+		std::vector<unsigned int> histogram; // Empty until it is needed
+	};
+	// The statistics of the measure, computed when they are first needed for a table
+	const MeasureStatistics& measureStatistics(int measure, bool withHistogram);
+
+	std::vector<MeasureStatistics> _statistics; // The statistics of each measure in the FeatureRegistry
+	const FeatureTable* _statisticsTable; // The table _statistics belong to
+
+	// The lines are kept in buffers on the graphics card between frames
+	// The vertices of axis a are the block of rows a * nRows to (a + 1) * nRows in the vertex buffer,
+	// at x = a. The segment of row r between the axes a and a + 1 has the indices r and nRows + r,
+	// counted from the start of block a, so the index buffers don't depend on the axes
+	GLuint _lineVertexBuffer; // One block of vertices per axis, with room for every column of the table
+	GLuint _linePickingBuffer; // The picking color of the vertices of two blocks
+	GLuint _visibleLineBuffer; // The indices of the segments of the rows that are not brushed
+	GLuint _linkedLineBuffer; // The indices of the segments of the visible rows that are linked
+	size_t _nVisibleLineIndices;
+	size_t _nLinkedLineIndices;
+	const FeatureTable* _lineTable; // The table the vertex buffers were filled from, or 0
+	VoxelRowMap _lineVoxelRows; // The rows of _lineTable that belong to the linked voxels
+	std::vector<int> _lineMeasures; // The measures of the axes the vertex buffers were filled with
+	std::vector<int> _vertexBlockMeasures; // The measure each block of the vertex buffer holds, or -1
+	std::vector<std::vector<float> > _measureValues; // The normalized values of each measure; empty until it gets an axis
+	std::vector<BinnedBitmapIndex> _brushIndices; // The index over the values of each measure that finds the rows within the handles
+	std::vector<uint64_t> _visibleRows; // The rows that were within the handles when the index buffers were filled
+	bool _lineIndicesValid; // Whether the index buffers match the handles and the linked rows
+	std::vector<unsigned int> _density; // The number of visible rows between each pair of bins, for each pair of axes
+	bool _densityValid; // Whether _density matches _visibleRows
+	std::vector<int> _densityMeasures; // The measures of the axes _density was counted for
+	LineSegmentIndex _segmentIndex; // The index over the values of the axes that finds the line under the cursor
+	bool _segmentIndexValid; // Whether _segmentIndex was built for the current axes
+	long _hoveredRow; // The row under the cursor, or -1
+
+	// While a handle is dragged, the moves are merged into the latest position, which is applied
+	// once per rendered frame
+	int _pendingHandle; // The handle that was moved since the last frame, or -1
+	tgt::vec2 _pendingHandlePosition; // The latest position it was moved to
+	int _pendingMoves; // The number of moves since the last frame
+	double _pendingSince; // The time of the first of these moves, in milliseconds
+	bool _frameScheduled; // Whether a frame was asked for that hasn't been rendered yet
 };
 
 } // namespace
@@ -2,14 +2,26 @@
 #define VRN_TNM_SCATTERPLOT_H
 
 #include "voreen/core/processors/renderprocessor.h"
-#include "modules/tnm093/include/tnm_common.h"
+#include "voreen/core/properties/boolproperty.h"
+#include "voreen/core/properties/floatproperty.h"
+#include "modules/tnm093/include/tnm_featurepyramid.h"
+#include "modules/tnm093/include/tnm_featureregistry.h"
+#include "modules/tnm093/include/tnm_featuretable.h"
 #include "modules/tnm093/include/indexproperty.h"
 
+#include <utility>
+#include <vector>
 
 namespace voreen {
 
-class TNMScatterPlot : public RenderProcessor {
+class TNMScatterPlot : public RenderProcessor, public FeatureConsumer {
 public:
+	// The state of a point, which the vertex shader reads as a set of flags
+    enum PointState {
+        PointLinked = 1, // The point is drawn larger
+        PointBrushed = 2 // The point is not drawn
+    };
+
     TNMScatterPlot();
     std::string getClassName() const   { return "TNMScatterPlot";           }
     std::string getCategory() const    { return "tnm093"               ; }
@@ -23,21 +35,54 @@ public:
 
 	bool isReady() const { return true; }
 
+	// The measures of the two axes
+    FeatureSet requestedFeatures() const;
+
 protected:
     void process();
 
+	// Asks for the table to be computed again if it lacks the measure of an axis
+    void axisChanged();
+
+	// Fills the position buffer with all rows of the table and the state buffer from the
+	// current brushing and linking
+    void updatePoints(const FeatureTable& data, const FeatureTable& table, int firstAxis, int secondAxis);
+	// Changes the states of only those points whose voxels were brushed or linked, or stopped
+	// being so, since the state buffer was filled
+    void updatePointStates();
+	// Sets or clears the flag of the rows of the voxels and collects the rows whose state changed
+    void changePointStates(const IndexSet& voxels, unsigned char flag, bool set, std::vector<size_t>& changedRows);
+
 private:
-    DataPort _inport; // The data that is to be rendered
+    FeatureTablePort _inport; // The data that is to be rendered
     RenderPort _outport; // A wrapping class for multiple framebufferobjects that can be rendered to
 
 	tgt::Shader* _shader; // The shader object that will do the rendering for us
 
-	// A wrapper for an integer member variable that can be set using the GUI
+	// A wrapper for an integer member variable that can be set using the GUI. The value is the
+	// index of the measure in the FeatureRegistry
     IntOptionProperty _firstAxis; 
     IntOptionProperty _secondAxis;
 
 	IndexProperty _brushingIndices; // A list of voxel indices that should be ignored in the rendering
 	IndexProperty _linkingIndices; // A list of voxel indices that should be enhanced during rendering
+
+    FloatProperty _frameBudget; // The time a frame may take while the user interacts, in milliseconds
+    BoolProperty _interacting; // Set while the user interacts with one of the linked views
+    LevelOfDetailSelector _levelOfDetail; // Picks the level of the pyramid that fits the budget
+
+	// The points stay in buffers on the graphics card between frames; one point per row of the table
+    GLuint _positionBuffer; // The values of the two axes of each row, as the table stores them
+    GLuint _stateBuffer; // The PointState flags of each row
+    const FeatureTable* _pointTable; // The table the buffers were filled from, or 0
+    int _pointAxes[2]; // The measures the position buffer was filled with
+    bool _pointsQuantized; // Whether the positions are quantized values
+    tgt::vec2 _positionScale; // Maps the uploaded values to [-1,1]
+    tgt::vec2 _positionOffset;
+    std::vector<unsigned char> _pointStates; // The content of the state buffer
+    VoxelRowMap _voxelRows; // The rows of the table the points were filled from that belong to the voxels
+    IndexSet _brushingSnapshot; // The brushing the state buffer shows
+    IndexSet _linkingSnapshot; // The linking the state buffer shows
 };
 
 } // namespace
@@ -0,0 +1,67 @@
+#ifndef VRN_TNM_SEGMENTINDEX_H
+#define VRN_TNM_SEGMENTINDEX_H
+
+#include "tgt/vector.h"
+
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+namespace voreen {
+
+// An index over the line segments of a parallel coordinates plot that finds the line closest to a
+// point without rendering anything. The axes are spread evenly over [-1,1] and each row is a
+// polyline through one value per axis. The segments in the gap between two neighbouring axes are
+// bucketed by the bins of their values on both axes; a query only looks at the rows in the buckets
+// whose segments can pass close enough to the point
+class LineSegmentIndex {
+public:
+	// The number of bins along each axis
+    static const int NumBins = 64;
+
+    LineSegmentIndex();
+
+	// Indexes nRows rows with one value in [-1,1] on each axis; columns[a] holds the values of axis
+	// a. The values are not copied and have to outlive the index or the next build
+    void build(const std::vector<const float*>& columns, size_t nRows);
+	// Like build, but the gaps between two columns that already had a gap between them are kept,
+	// so that reordering, adding or removing an axis only indexes the gaps next to it. The values
+	// of the kept columns must not have changed
+    void update(const std::vector<const float*>& columns, size_t nRows);
+    void clear();
+
+    size_t numRows() const { return _nRows; }
+    size_t numAxes() const { return _gaps.empty() ? 0 : _gaps.size() + 1; }
+
+	// Returns the row whose line passes closest to the point, measured vertically, or -1 if no line
+	// comes closer than maxDistance. Only the rows whose bits are set in visible are considered;
+	// an empty bitmap stands for all rows
+    long findNearest(const tgt::vec2& point, float maxDistance, const std::vector<uint64_t>& visible) const;
+
+private:
+	// The segments between two neighbouring axes
+    struct Gap {
+        Gap() : left(0), right(0) {}
+        void swap(Gap& other);
+
+        const float* left; // The values on the left axis
+        const float* right; // The values on the right axis
+		// The rows of the bucket with the bins l and r are rows[offsets[i]] to rows[offsets[i + 1]],
+		// with i = l * NumBins + r
+        std::vector<size_t> offsets;
+        std::vector<uint32_t> rows;
+    };
+
+	// The bin of the value; values outside of [-1,1] go to the first or last bin
+    int bin(float value) const;
+	// Sorts the rows of the gap into its buckets
+    void buildGap(Gap& gap) const;
+
+    size_t _nRows;
+    std::vector<Gap> _gaps; // From the leftmost to the rightmost gap
+};
+
+} // namespace
+
+#endif // VRN_TNM_SEGMENTINDEX_H
@@ -2,7 +2,12 @@
 #define VRN_TNM_VOLUMEINFORMATION_H
 
 #include "voreen/core/processors/processor.h"
-#include "modules/tnm093/include/tnm_common.h"
+#include "voreen/core/properties/intproperty.h"
+#include "voreen/core/properties/boolproperty.h"
+#include "voreen/core/properties/filedialogproperty.h"
+#include "voreen/core/properties/optionproperty.h"
+#include "modules/tnm093/include/tnm_featurepyramid.h"
+#include "modules/tnm093/include/tnm_featuretable.h"
 
 namespace voreen {
 
@@ -20,10 +25,31 @@ protected:
     void process();
 
 private:
+	// Builds the level-of-detail pyramid over the table if it was asked for, or drops the old one
+    void updatePyramid(const tgt::svec3& dimensions, int nThreads);
+
     VolumePort _inport; // The inport that contains the volume for which the information is computed
-    DataPort _outport; // The outport containing the computed measures
+    FeatureTablePort _outport; // The outport containing the computed measures
+
+    IntProperty _numThreads; // The number of worker threads that share the extraction
+    IntProperty _neighbourhoodRadius; // The radius of the neighbourhood for average and standard deviation
+    IntOptionProperty _storageFormat; // Whether the measures are stored as floats or quantized to 16 bits
+
+    BoolProperty _streamToDisk; // Stream the measures to the spill file instead of keeping them in memory
+    FileDialogProperty _spillFile; // The file the measures are streamed to
+    IntProperty _brickDepth; // The number of planes that are processed and kept in memory at once
+
+    BoolProperty _useCache; // Load the measures from the cache directory if they were computed before
+    FileDialogProperty _cacheDirectory; // The directory in which the computed measures are cached
+
+    BoolProperty _buildPyramid; // Build a level-of-detail pyramid the views can draw while the user interacts
+
+    FeatureTable* _table; // The local copy of the computed data; ownership stays with this object at all times
+    FeatureTable _brick; // The measures of the current brick while streaming; kept to reuse its memory
+    FeaturePyramid _pyramid; // The coarser levels of _table
 
-    Data* _data; // The local copy of the computed data; ownership stays with this object at all times
+    const Volume* _hashedVolume; // The volume _volumeHash belongs to
+    uint64_t _volumeHash; // The hash of the voxels for the cache key, kept while the inport doesn't change
 };
 
 } // namespace
@@ -3,8 +3,9 @@
 
 namespace voreen {
 
-IndexProperty::IndexProperty(const std::string& id, const std::string& guiText) 
-    : TemplateProperty(id, guiText, std::set<unsigned int>())
+IndexProperty::IndexProperty(const std::string& id, const std::string& guiText,
+                             Processor::InvalidationLevel invalidationLevel)
+    : TemplateProperty(id, guiText, IndexSet(), invalidationLevel)
 {}
 
 IndexProperty::IndexProperty()
@@ -25,12 +26,12 @@ int IndexProperty::getVariantType() const {
 
 Variant IndexProperty::getVariant(bool normalized) const {
     Variant r;
-    r.set<std::set<unsigned int> >(get(), Variant::VariantTypeUserType + 1);
+    r.set<IndexSet>(get(), Variant::VariantTypeUserType + 1);
     return r;
 }
 
 void IndexProperty::setVariant(const Variant& v, bool normalized) {
-    set(v.get<std::set<unsigned int> >());
+    set(v.get<IndexSet>());
 }
 
 } // namespace voreen
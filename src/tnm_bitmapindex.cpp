@@ -0,0 +1,116 @@
+#include "modules/tnm093/include/tnm_bitmapindex.h"
+#include "modules/tnm093/include/tnm_bits.h"
+
+#include <algorithm>
+
+namespace voreen {
+
+const int BinnedBitmapIndex::NumBins;
+
+BinnedBitmapIndex::BinnedBitmapIndex() {
+    clear();
+}
+
+void BinnedBitmapIndex::clear() {
+    _values = 0;
+    _nRows = 0;
+    _nColumns = 0;
+    _minimum = 0.f;
+    _maximum = 0.f;
+    _binScale = 0.f;
+    std::vector<uint64_t>().swap(_bitmaps);
+}
+
+int BinnedBitmapIndex::bin(float value) const {
+    const float x = (value - _minimum) * _binScale;
+	// The maximum ends up in the last bin
+    if (x >= NumBins)
+        return NumBins - 1;
+    if (x >= 0.f)
+        return static_cast<int>(x);
+    return 0;
+}
+
+void BinnedBitmapIndex::build(const float* values, size_t nRows, size_t nColumns, float minimum, float maximum) {
+    _values = values;
+    _nRows = nRows;
+    _nColumns = nColumns;
+    _minimum = minimum;
+    _maximum = maximum;
+    _binScale = (maximum > minimum) ? NumBins / (maximum - minimum) : 0.f;
+
+    const size_t nWords = numWords();
+    _bitmaps.assign(nColumns * NumBins * nWords, 0);
+    for (size_t row = 0; row < nRows; ++row) {
+        const uint64_t bit = uint64_t(1) << (row % 64);
+        for (size_t c = 0; c < nColumns; ++c) {
+            const float value = values[row * nColumns + c];
+			// Values that are not numbers are in no bin, so they are never within a range
+            if (value == value)
+                _bitmaps[(c * NumBins + bin(value)) * nWords + row / 64] |= bit;
+        }
+    }
+}
+
+void BinnedBitmapIndex::select(const float* lower, const float* upper, std::vector<uint64_t>& selection) const {
+    selection.assign(numWords(), ~uint64_t(0));
+    if (_nRows % 64 != 0)
+        selection.back() = (uint64_t(1) << (_nRows % 64)) - 1;
+    narrow(lower, upper, selection);
+}
+
+void BinnedBitmapIndex::narrow(const float* lower, const float* upper, std::vector<uint64_t>& selection) const {
+    const size_t nWords = numWords();
+    for (size_t c = 0; c < _nColumns; ++c) {
+		// A range that covers all values doesn't remove any rows
+        if (lower[c] <= _minimum && upper[c] >= _maximum)
+            continue;
+        if (!(lower[c] <= upper[c])) {
+            std::fill(selection.begin(), selection.end(), 0);
+            break;
+        }
+
+		// The binning is monotonic, so every value in a bin between the bins of the ends of the
+		// range lies within the range. The values in the bins at the ends only have to be checked
+		// if the range doesn't cover the whole bin; the bounds of the bins are widened a little, as
+		// the binning rounds
+        const int first = bin(lower[c]);
+        const int last = bin(upper[c]);
+        const float slack = 1e-3f;
+        const bool checkFirst = (first == 0) ? lower[c] > _minimum : lower[c] > _minimum + (first - slack) / _binScale;
+        const bool checkLast = (last == NumBins - 1) ? upper[c] < _maximum : upper[c] < _minimum + (last + 1 + slack) / _binScale;
+        const int firstCovered = checkFirst ? first + 1 : first;
+        const int lastCovered = checkLast ? last - 1 : last;
+        int checked[2];
+        int nChecked = 0;
+        if (checkFirst)
+            checked[nChecked++] = first;
+        if (checkLast && (last != first || !checkFirst))
+            checked[nChecked++] = last;
+        const uint64_t* bitmaps = &_bitmaps[c * NumBins * nWords];
+
+		// The words are independent of each other, so they can be handled concurrently
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static, 1024)
+#endif
+        for (long w = 0; w < static_cast<long>(nWords); ++w) {
+			// Rows that were dropped by an earlier column don't need to be looked at
+            if (selection[w] == 0)
+                continue;
+            uint64_t within = 0;
+            for (int b = firstCovered; b <= lastCovered; ++b)
+                within |= bitmaps[b * nWords + w];
+            for (int i = 0; i < nChecked; ++i) {
+                for (uint64_t bits = bitmaps[checked[i] * nWords + w] & selection[w]; bits != 0; bits &= bits - 1) {
+                    const size_t row = w * 64 + lowestBit(bits);
+                    const float value = _values[row * _nColumns + c];
+                    if (!(value < lower[c]) && !(value > upper[c]))
+                        within |= uint64_t(1) << (row % 64);
+                }
+            }
+            selection[w] &= within;
+        }
+    }
+}
+
+} // namespace
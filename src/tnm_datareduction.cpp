@@ -1,11 +1,257 @@
 #include "modules/tnm093/include/tnm_datareduction.h"
+#include "modules/tnm093/include/tnm_featurefile.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 namespace voreen {
 
 namespace {
-	// We will sort the data using this function to ensure a strong ordering on the voxel indices
-	bool sortByIndex(const VoxelDataItem& lhs, const VoxelDataItem& rhs) {
-		return lhs.voxelIndex < rhs.voxelIndex;
+	// One step of SplitMix64; returns the next number and advances the state
+	uint64_t splitMix(uint64_t& state) {
+		state += 0x9E3779B97F4A7C15ULL;
+		uint64_t z = state;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+
+	// Knuth's selection sampling (algorithm S). It decides for each of nRows rows in turn whether
+	// the row is kept, such that exactly nKept rows are kept and every subset of that size is
+	// equally likely. As the decisions are made in the order of the rows, the kept rows never need
+	// to be sorted. The random numbers come from SplitMix64, so a seed gives the same selection
+	// on every platform
+	class SelectionSampler {
+	public:
+		SelectionSampler(size_t nRows, size_t nKept, uint64_t seed)
+			: _remainingRows(nRows)
+			, _remainingKept(std::min(nKept, nRows))
+			, _state(seed)
+		{}
+
+		// Returns whether the next row is kept
+		bool keepNext() {
+			// The row is kept with the probability remainingKept / remainingRows
+			const bool keep = _remainingRows * nextUniform() < _remainingKept;
+			--_remainingRows;
+			if (keep)
+				--_remainingKept;
+			return keep;
+		}
+
+	private:
+		// A uniformly distributed number in [0,1)
+		double nextUniform() {
+			return (splitMix(_state) >> 11) * (1.0 / 9007199254740992.0);
+		}
+
+		size_t _remainingRows;
+		size_t _remainingKept;
+		uint64_t _state;
+	};
+
+	// A random number in [0,1) that is fixed for the row and the seed
+	double rowPriority(size_t row, uint64_t seed) {
+		uint64_t state = (seed << 32) ^ row;
+		return (splitMix(state) >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	// Orders bins by the number of rows in them
+	struct ByCount {
+		explicit ByCount(const std::vector<size_t>& counts) : counts(&counts) {}
+		bool operator()(size_t lhs, size_t rhs) const { return (*counts)[lhs] < (*counts)[rhs]; }
+		const std::vector<size_t>* counts;
+	};
+
+	// Divides nKept rows among the bins such that no bin gets more rows than it has and the
+	// smallest quota is as large as possible. Sparse bins are kept completely; the dense ones
+	// share the rest equally, with the rows that don't divide evenly going to the densest bins
+	std::vector<size_t> binQuotas(const std::vector<size_t>& counts, size_t nKept) {
+		std::vector<size_t> order(counts.size());
+		for (size_t b = 0; b < order.size(); ++b)
+			order[b] = b;
+		std::stable_sort(order.begin(), order.end(), ByCount(counts));
+
+		std::vector<size_t> quotas(counts.size(), 0);
+		size_t remaining = nKept;
+		for (size_t i = 0; i < order.size(); ++i) {
+			const size_t nLeft = order.size() - i;
+			if (counts[order[i]] <= remaining / nLeft) {
+				quotas[order[i]] = counts[order[i]];
+				remaining -= counts[order[i]];
+				continue;
+			}
+			// This bin and all denser ones have more rows than their share
+			const size_t share = remaining / nLeft;
+			const size_t extra = remaining % nLeft;
+			for (size_t j = i; j < order.size(); ++j)
+				quotas[order[j]] = share + ((j >= order.size() - extra) ? 1 : 0);
+			break;
+		}
+		return quotas;
+	}
+
+	// Decides for the rows of a table in turn whether they are kept. Uniform sampling is a single
+	// selection sampling over all rows. Stratified sampling bins the rows on a regular grid over up
+	// to four measures and samples each bin on its own, with a quota from binQuotas. Rare
+	// combinations of values, such as the boundary voxels with a high gradient, then survive at
+	// full density, while the large uniform regions are thinned out. Either way, the rows are kept
+	// in the order of the table
+	class RowSampler {
+	public:
+		static const int MaxMeasures = 4;
+
+		RowSampler(size_t nRows, size_t nKept, uint64_t seed)
+			: _nMeasures(0)
+			, _binsPerMeasure(1)
+		{
+			_samplers.push_back(SelectionSampler(nRows, nKept, seed));
+		}
+
+		// Bins the rows of the table over its first MaxMeasures measures, which takes two passes over it
+		RowSampler(const FeatureTable& table, size_t nKept, int binsPerMeasure, uint64_t seed)
+			: _nMeasures(0)
+			, _binsPerMeasure(binsPerMeasure)
+		{
+			for (int m = 0; m < FeatureRegistry::MaxFeatures && _nMeasures < MaxMeasures; ++m) {
+				if (table.hasFeature(m))
+					_measures[_nMeasures++] = m;
+			}
+
+			// The grid spans the range of each measure
+			for (int i = 0; i < _nMeasures; ++i) {
+				_minimum[i] = std::numeric_limits<float>::max();
+				_binScale[i] = -std::numeric_limits<float>::max();
+			}
+			for (FeatureTableCursor cursor(table); cursor.next(); ) {
+				for (int i = 0; i < _nMeasures; ++i) {
+					const float* column = cursor.column(_measures[i]);
+					for (size_t r = 0; r < cursor.chunkSize(); ++r) {
+						_minimum[i] = std::min(_minimum[i], column[r]);
+						_binScale[i] = std::max(_binScale[i], column[r]);
+					}
+				}
+			}
+			for (int i = 0; i < _nMeasures; ++i) {
+				const float range = _binScale[i] - _minimum[i];
+				_binScale[i] = (range > 0.f) ? _binsPerMeasure / range : 0.f;
+			}
+
+			size_t nBins = 1;
+			for (int i = 0; i < _nMeasures; ++i)
+				nBins *= _binsPerMeasure;
+			std::vector<size_t> counts(nBins, 0);
+			for (FeatureTableCursor cursor(table); cursor.next(); ) {
+				for (size_t r = 0; r < cursor.chunkSize(); ++r)
+					++counts[bin(cursor, r)];
+			}
+
+			const std::vector<size_t> quotas = binQuotas(counts, std::min(nKept, table.size()));
+			_samplers.reserve(nBins);
+			for (size_t b = 0; b < nBins; ++b)
+				_samplers.push_back(SelectionSampler(counts[b], quotas[b], splitMix(seed)));
+		}
+
+		// Returns whether the next row, which is the row of storage, is kept
+		bool keepNext(const FeatureTable& storage, size_t row) {
+			if (_nMeasures == 0)
+				return _samplers[0].keepNext();
+			float values[MaxMeasures];
+			for (int i = 0; i < _nMeasures; ++i)
+				values[i] = storage.value(row, _measures[i]);
+			return _samplers[bin(values)].keepNext();
+		}
+
+		// Returns whether the next row, which is row i of the cursor's chunk, is kept
+		bool keepNext(const FeatureTableCursor& cursor, size_t i) {
+			return _samplers[(_nMeasures == 0) ? 0 : bin(cursor, i)].keepNext();
+		}
+
+	private:
+		size_t bin(const FeatureTableCursor& cursor, size_t i) const {
+			float values[MaxMeasures];
+			for (int j = 0; j < _nMeasures; ++j)
+				values[j] = cursor.column(_measures[j])[i];
+			return bin(values);
+		}
+
+		// The bin of the values of the binned measures
+		size_t bin(const float* values) const {
+			size_t bin = 0;
+			for (int i = 0; i < _nMeasures; ++i) {
+				const float x = (values[i] - _minimum[i]) * _binScale[i];
+				// Written such that NaN ends up in the first bin, and the maximum in the last
+				int b = 0;
+				if (x >= _binsPerMeasure)
+					b = _binsPerMeasure - 1;
+				else if (x >= 0.f)
+					b = static_cast<int>(x);
+				bin = bin * _binsPerMeasure + b;
+			}
+			return bin;
+		}
+
+		int _measures[MaxMeasures];
+		int _nMeasures; // 0 for uniform sampling
+		int _binsPerMeasure;
+		float _minimum[MaxMeasures];
+		float _binScale[MaxMeasures]; // The number of bins per unit of each measure
+		std::vector<SelectionSampler> _samplers; // One for each bin
+	};
+
+	// Orders row numbers by the voxel indices of the rows
+	struct ByVoxelIndex {
+		explicit ByVoxelIndex(const FeatureTable& table) : table(&table) {}
+		bool operator()(size_t lhs, size_t rhs) const { return table->voxelIndex(lhs) < table->voxelIndex(rhs); }
+		const FeatureTable* table;
+	};
+
+	// Copies the values of the rows into target, in the order of rows
+	template <typename T>
+	void gatherRows(const T* source, T* target, const std::vector<size_t>& rows) {
+		for (size_t i = 0; i < rows.size(); ++i)
+			target[i] = source[rows[i]];
+	}
+
+	// Tables that were spilled to disk are reduced in a single pass over the file, with the rows
+	// selected the same way as for tables in memory
+	FeatureTable* reduceSpilledTable(const FeatureTable& table, RowSampler& sampler) {
+		std::vector<std::vector<float> > columns(FeatureRegistry::MaxFeatures);
+		std::vector<uint64_t> indices;
+
+		FeatureTableCursor cursor(table);
+		while (cursor.next()) {
+			for (size_t i = 0; i < cursor.chunkSize(); ++i) {
+				if (!sampler.keepNext(cursor, i))
+					continue;
+				for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m) {
+					if (table.hasFeature(m))
+						columns[m].push_back(cursor.column(m)[i]);
+				}
+				indices.push_back(cursor.voxelIndex(i));
+			}
+		}
+
+		// The cursor restores quantized values to floats. Quantizing them again with the same
+		// quantization gives back exactly the values in the file
+		FeatureTable* result = new FeatureTable(indices.size(), true, table.features(), table.storageFormat());
+		if (!indices.empty()) {
+			for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m) {
+				if (!table.hasFeature(m))
+					continue;
+				if (table.isQuantized()) {
+					result->setQuantization(m, table.quantization(m));
+					quantizeValues(&columns[m][0], result->quantizedColumn(m), columns[m].size(), table.quantization(m));
+				}
+				else
+					std::copy(columns[m].begin(), columns[m].end(), result->column(m));
+			}
+			std::copy(indices.begin(), indices.end(), result->indexColumn());
+		}
+		// The rows are kept in the order of the file
+		result->setSortedByVoxelIndex(table.isSortedByVoxelIndex());
+		return result;
 	}
 }
 
@@ -13,10 +259,40 @@ TNMDataReduction::TNMDataReduction()
     : _inport(Port::INPORT, "in.data")
     , _outport(Port::OUTPORT, "out.data")
     , _percentage("percentage", "Percentage of Dropped Data")
+    , _useTargetRows("useTargetRows", "Use Target Row Count", false)
+    , _targetRows("targetRows", "Target Row Count", 100000, 1, std::numeric_limits<int>::max())
+    , _samplingMode("samplingMode", "Sampling Mode")
+    , _binsPerMeasure("binsPerMeasure", "Bins per Measure", 8, 2, 16)
+    , _seed("seed", "Random Seed", 0, 0, std::numeric_limits<int>::max())
+    , _progressive("progressive", "Progressive", false)
+    , _initialRows("initialRows", "Initial Row Count", 10000, 1, std::numeric_limits<int>::max())
+    , _progressiveSource(0)
+    , _nSelected(0)
+    , _nPublished(0)
 {
     addPort(_inport);
     addPort(_outport);
     addProperty(_percentage);
+    addProperty(_useTargetRows);
+    addProperty(_targetRows);
+    _samplingMode.addOption("uniform", "Uniform", SamplingUniform);
+    _samplingMode.addOption("stratified", "Stratified", SamplingStratified);
+    addProperty(_samplingMode);
+    addProperty(_binsPerMeasure);
+    addProperty(_seed);
+    addProperty(_progressive);
+    addProperty(_initialRows);
+
+	// Any change of the reduction starts a progression from the beginning
+    Property* properties[] = { &_percentage, &_useTargetRows, &_targetRows, &_samplingMode, &_binsPerMeasure,
+                               &_seed, &_progressive, &_initialRows };
+    for (size_t i = 0; i < sizeof(properties) / sizeof(properties[0]); ++i)
+        properties[i]->onChange(CallMemberAction<TNMDataReduction>(this, &TNMDataReduction::restartProgression));
+}
+
+FeatureSet TNMDataReduction::requestedFeatures() const {
+	// The reduced table contains the same measures, so they are needed by our consumers
+    return voreen::requestedFeatures(_outport);
 }
 
 Processor* TNMDataReduction::create() const {
@@ -25,25 +301,165 @@ Processor* TNMDataReduction::create() const {
 }
 
 void TNMDataReduction::process() {
-    if (!_inport.hasData())
+    if (_inport.hasChanged())
+        restartProgression();
+    if (!_inport.hasData()) {
+		// A view on the outport refers to the table that was on the inport, so it can't be kept
+        _outport.setData(0);
+        _pyramid.clear();
+        return;
+    }
+
+	// A progression that is under way publishes the next part of the rows it already selected.
+	// Once it is complete, the outport already has all of them
+    if (_nSelected > 0) {
+        if (_nPublished < _nSelected)
+            publishNextPart();
         return;
+    }
 
 	// We have checked above that there is data, so the dereferencing is safe
-    const Data& inportData = *(_inport.getData());
-    const float percentage = _percentage.get();
+    const FeatureTable& inportData = *(_inport.getData());
+	// The number of rows is either given directly or by the percentage that is dropped
+    const size_t nRows = inportData.size();
+    const size_t nKept = _useTargetRows.get() ? std::min(nRows, static_cast<size_t>(_targetRows.get()))
+                                              : nRows - std::min(nRows, static_cast<size_t>(nRows * _percentage.get()));
+	// The same seed always selects the same rows of the same table
+    const uint64_t seed = static_cast<uint64_t>(_seed.get());
+    RowSampler sampler = (_samplingMode.getValue() == SamplingStratified)
+        ? RowSampler(inportData, nKept, _binsPerMeasure.get(), seed)
+        : RowSampler(nRows, nKept, seed);
+
+    if (!inportData.isResident()) {
+        publish(reduceSpilledTable(inportData, sampler));
+        return;
+    }
+
+    if (inportData.isSortedByVoxelIndex()) {
+		// The surviving rows are already in the order of the voxel indices, so instead of copying
+		// them, the new data is a view that marks them in a bitmap over the rows of the table that
+		// holds the values. If the input is a view itself, that is its source, so views of views
+		// never come up
+        const FeatureTable& storage = inportData.storage();
+        std::vector<uint64_t> selection((storage.size() + 63) / 64, 0);
+        size_t nSelected = 0;
+		// Should the sampler keep fewer than nKept rows, for instance because a value falls into a
+		// different bin than in the pass that counted them, the loop ends with the table and the
+		// view has the nSelected rows that were actually kept
+        for (FeatureRowIterator it(inportData); !it.atEnd() && nSelected < nKept; it.next()) {
+            if (sampler.keepNext(storage, it.storageRow())) {
+                selection[it.storageRow() / 64] |= uint64_t(1) << (it.storageRow() % 64);
+                ++nSelected;
+            }
+        }
+        if (_progressive.get()) {
+            _progressiveSelection.swap(selection);
+            _progressiveSource = &storage;
+            _nSelected = nSelected;
+            _nPublished = 0;
+            publishNextPart();
+            return;
+        }
+        FeatureTable* outportData = new FeatureTable;
+        outportData->attachView(storage, selection);
+        publish(outportData);
+        return;
+    }
+
+	// Otherwise the surviving rows are copied, so that they can be sorted. Select them in a single
+	// pass; they come out in the order of the input table, as rows of the table holding the values
+    const FeatureTable& storage = inportData.storage();
+    std::vector<size_t> rows;
+    rows.reserve(nKept);
+    for (FeatureRowIterator it(inportData); !it.atEnd() && rows.size() < nKept; it.next()) {
+        if (sampler.keepNext(storage, it.storageRow()))
+            rows.push_back(it.storageRow());
+    }
+
+	// Keep the voxel indices in order for faster processing later
+    std::stable_sort(rows.begin(), rows.end(), ByVoxelIndex(storage));
+
+	// Our new data; as only some voxels survive, it needs an index column. Quantized values are
+	// copied as they are
+    FeatureTable* outportData = new FeatureTable(rows.size(), true, storage.features(), storage.storageFormat());
+    for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m) {
+        if (!storage.hasFeature(m))
+            continue;
+        if (storage.isQuantized()) {
+            outportData->setQuantization(m, storage.quantization(m));
+            gatherRows(storage.quantizedColumn(m), outportData->quantizedColumn(m), rows);
+        }
+        else
+            gatherRows(storage.column(m), outportData->column(m), rows);
+    }
+    uint64_t* indices = outportData->indexColumn();
+    for (size_t i = 0; i < rows.size(); ++i)
+        indices[i] = storage.voxelIndex(rows[i]);
+    outportData->setSortedByVoxelIndex(true);
+
+	// Place the new data into the outport (and transferring ownership at the same time)
+    publish(outportData);
+}
 
-    // Our new data
-    Data* outportData = new Data;
-    int x = (inportData.size()*percentage);
+void TNMDataReduction::afterProcess() {
+    Processor::afterProcess();
+	// Being invalid gets us evaluated again, together with the views that draw the new part
+    if (_nPublished < _nSelected)
+        invalidate();
+}
+
+void TNMDataReduction::publish(FeatureTable* table) {
+	// The table that is replaced refers to the pyramid, too, but it isn't drawn anymore
+    const FeaturePyramid* source = _inport.getData()->pyramid();
+    if (source) {
+        _pyramid.buildFiltered(*source, *table);
+        table->setPyramid(&_pyramid);
+    }
+    else
+        _pyramid.clear();
+    _outport.setData(table);
+}
 
-    outportData->assign(inportData.begin(),inportData.end());
-    std::random_shuffle ( outportData->begin(), outportData->end());
-    outportData->erase(outportData->begin(),outportData->begin()+x);
+void TNMDataReduction::publishNextPart() {
+	// The parts grow geometrically, so drawing all of them costs the views at most about twice as
+	// much as drawing the whole selection once, while the first part is drawn almost at once.
+	// A voxel has a different row in every part, which is why the views key the brushing and the
+	// linking by voxel and look up the rows again for each part they draw
+    _nPublished = (_nPublished == 0) ? std::min(_nSelected, static_cast<size_t>(_initialRows.get()))
+                                     : std::min(_nSelected, 2 * _nPublished);
+
+    std::vector<uint64_t> part;
+    if (_nPublished == _nSelected) {
+		// The last part is the whole selection, which isn't needed anymore
+        part.swap(_progressiveSelection);
+    }
+    else {
+		// Every selected row has a fixed random priority, and a part contains the rows whose priority
+		// is below the fraction of the selection it is meant to contain. So each part is a random
+		// sample of the selection that contains all earlier parts; the number of rows is only
+		// about the number asked for
+        const uint64_t seed = static_cast<uint64_t>(_seed.get());
+        const double fraction = static_cast<double>(_nPublished) / _nSelected;
+        part.resize(_progressiveSelection.size(), 0);
+        for (size_t w = 0; w < _progressiveSelection.size(); ++w) {
+            for (uint64_t bits = _progressiveSelection[w]; bits != 0; bits &= bits - 1) {
+                const size_t row = w * 64 + lowestBit(bits);
+                if (rowPriority(row, seed) < fraction)
+                    part[w] |= uint64_t(1) << (row % 64);
+            }
+        }
+    }
+
+    FeatureTable* outportData = new FeatureTable;
+    outportData->attachView(*_progressiveSource, part);
+    publish(outportData);
+}
 
-    // sort the data by the voxel index for faster processing later
-    std::sort(outportData->begin(), outportData->end(), sortByIndex);
-    // Place the new data into the outport (and transferring ownership at the same time)
-    _outport.setData(outportData);
+void TNMDataReduction::restartProgression() {
+    std::vector<uint64_t>().swap(_progressiveSelection);
+    _progressiveSource = 0;
+    _nSelected = 0;
+    _nPublished = 0;
 }
 
 } // namespace
@@ -0,0 +1,22 @@
+#include "modules/tnm093/include/tnm_datatofeaturetable.h"
+
+namespace voreen {
+
+TNMDataToFeatureTable::TNMDataToFeatureTable()
+    : Processor()
+    , _inport(Port::INPORT, "in.data")
+    , _outport(Port::OUTPORT, "out.data")
+{
+    addPort(_inport);
+    addPort(_outport);
+}
+
+void TNMDataToFeatureTable::process() {
+    if (!_inport.hasData())
+        return;
+
+	// The new table is owned by the outport from now on
+    _outport.setData(FeatureTable::createFromData(*(_inport.getData())));
+}
+
+} // namespace
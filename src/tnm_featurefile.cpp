@@ -0,0 +1,386 @@
+#include "modules/tnm093/include/tnm_featurefile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace voreen {
+
+namespace {
+	const char FileMagic[4] = { 'T', 'N', 'M', 'F' };
+
+	uint64_t paddedSize(uint64_t bytes) {
+		const uint64_t alignment = FeatureTable::ColumnAlignment;
+		return (bytes + alignment - 1) / alignment * alignment;
+	}
+
+	// fseek only takes a long, which is 32 bits on Windows
+	bool seekTo(std::FILE* file, uint64_t offset) {
+#ifdef _MSC_VER
+		return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+		return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+	}
+}
+
+const uint32_t FeatureFileHeader::CurrentVersion;
+const size_t FeatureFileHeader::Size;
+
+uint64_t FeatureFileHeader::valueSize() const {
+    return storageFormat == FeatureTable::StorageUInt16 ? sizeof(uint16_t) : sizeof(float);
+}
+
+uint64_t FeatureFileHeader::quantizationOffset() const {
+    return Size;
+}
+
+uint64_t FeatureFileHeader::columnOffset(int column) const {
+    const uint64_t quantizationSize = (storageFormat == FeatureTable::StorageUInt16)
+        ? paddedSize(numColumns * sizeof(FeatureTable::Quantization)) : 0;
+    return quantizationOffset() + quantizationSize + column * paddedSize(numRows * valueSize());
+}
+
+uint64_t FeatureFileHeader::indexOffset() const {
+    return columnOffset(numColumns);
+}
+
+uint64_t FeatureFileHeader::fileSize() const {
+    return indexOffset() + (hasIndexColumn ? paddedSize(numRows * sizeof(uint64_t)) : 0);
+}
+
+bool FeatureFileHeader::read(const std::string& path) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == 0)
+        return false;
+    const bool valid = std::fread(this, sizeof(*this), 1, file) == 1
+        && std::memcmp(magic, FileMagic, sizeof(FileMagic)) == 0
+        && version == CurrentVersion;
+    std::fclose(file);
+    return valid;
+}
+
+//
+// FeatureFileWriter
+//
+
+FeatureFileWriter::FeatureFileWriter()
+    : _file(0)
+{
+    std::memset(&_header, 0, sizeof(_header));
+}
+
+FeatureFileWriter::~FeatureFileWriter() {
+    close();
+}
+
+bool FeatureFileWriter::open(const std::string& path, size_t numRows, const FeatureTable& layout, uint64_t cacheKey) {
+    close();
+    _file = std::fopen(path.c_str(), "wb");
+    if (_file == 0)
+        return false;
+
+    std::memset(&_header, 0, sizeof(_header));
+    std::memcpy(_header.magic, FileMagic, sizeof(FileMagic));
+    _header.version = FeatureFileHeader::CurrentVersion;
+    _header.numRows = numRows;
+    _header.numColumns = layout.numColumns();
+    _header.hasIndexColumn = layout.hasIndexColumn() ? 1 : 0;
+    _header.cacheKey = cacheKey;
+    _header.features = layout.features();
+    _header.storageFormat = layout.storageFormat();
+
+	// The header is padded to its full size and the last byte of the file is written, so that
+	// the file has its final size right away
+    char headerBytes[FeatureFileHeader::Size];
+    std::memset(headerBytes, 0, sizeof(headerBytes));
+    std::memcpy(headerBytes, &_header, sizeof(_header));
+    std::vector<FeatureTable::Quantization> quantization;
+    if (layout.isQuantized()) {
+        for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m) {
+            if (layout.hasFeature(m))
+                quantization.push_back(layout.quantization(m));
+        }
+    }
+    const char zero = 0;
+    const bool success = writeAt(0, headerBytes, sizeof(headerBytes))
+        && (quantization.empty() || writeAt(_header.quantizationOffset(), &quantization[0],
+                                            quantization.size() * sizeof(FeatureTable::Quantization)))
+        && writeAt(_header.fileSize() - 1, &zero, 1);
+    if (!success)
+        close();
+    return success;
+}
+
+void FeatureFileWriter::close() {
+    if (_file)
+        std::fclose(_file);
+    _file = 0;
+}
+
+bool FeatureFileWriter::writeRows(size_t firstRow, const FeatureTable& table) {
+    if (_file == 0 || table.isView() || firstRow + table.size() > _header.numRows || table.features() != _header.features
+        || static_cast<uint32_t>(table.storageFormat()) != _header.storageFormat)
+    {
+        return false;
+    }
+
+    bool success = true;
+    int column = 0;
+    const size_t valueSize = table.valueSize();
+    for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m) {
+        if (!table.hasFeature(m))
+            continue;
+        success &= writeAt(_header.columnOffset(column++) + firstRow * valueSize,
+                           table.columnData(m), table.size() * valueSize);
+    }
+    if (_header.hasIndexColumn) {
+        success &= writeAt(_header.indexOffset() + firstRow * sizeof(uint64_t),
+                           table.indexColumn(), table.size() * sizeof(uint64_t));
+    }
+    return success;
+}
+
+bool FeatureFileWriter::writeAt(uint64_t offset, const void* data, size_t bytes) {
+    if (bytes == 0)
+        return true;
+    return seekTo(_file, offset) && std::fwrite(data, 1, bytes, _file) == bytes;
+}
+
+//
+// MappedFile
+//
+
+MappedFile::MappedFile()
+    : _data(0)
+    , _size(0)
+#ifdef _WIN32
+    , _fileHandle(0)
+    , _mappingHandle(0)
+#endif
+{}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_WRITECOPY, 0, 0, 0);
+    if (mapping == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    void* data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (data == 0) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    _fileHandle = file;
+    _mappingHandle = mapping;
+    _data = data;
+    _size = static_cast<uint64_t>(size.QuadPart);
+#else
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file == -1)
+        return false;
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+    void* data = mmap(0, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	// The mapping stays valid after the file is closed
+    ::close(file);
+    if (data == MAP_FAILED)
+        return false;
+    _data = data;
+    _size = static_cast<uint64_t>(status.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (_data == 0)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(_mappingHandle);
+    CloseHandle(_fileHandle);
+    _fileHandle = 0;
+    _mappingHandle = 0;
+#else
+    munmap(_data, static_cast<size_t>(_size));
+#endif
+    _data = 0;
+    _size = 0;
+}
+
+//
+// FeatureTableCursor
+//
+
+FeatureTableCursor::FeatureTableCursor(const FeatureTable& table, size_t chunkSize)
+    : _table(table)
+    , _maxChunkSize(std::max<size_t>(chunkSize, 1))
+    , _chunkBegin(0)
+    , _chunkSize(0)
+    , _indices(0)
+    , _rows(table)
+    , _file(0)
+{
+    for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m)
+        _columns[m] = 0;
+
+    if (!_table.isResident()) {
+        _file = std::fopen(_table.spillFile().c_str(), "rb");
+        const bool valid = _file
+            && std::fread(&_header, sizeof(_header), 1, _file) == 1
+            && std::memcmp(_header.magic, FileMagic, sizeof(FileMagic)) == 0
+            && _header.version == FeatureFileHeader::CurrentVersion
+            && _header.numRows == _table.size()
+            && _header.features == _table.features()
+            && _header.storageFormat == static_cast<uint32_t>(_table.storageFormat())
+            && _header.numColumns == static_cast<uint32_t>(_table.numColumns());
+        if (!valid) {
+            LERRORC("FeatureTableCursor", "Could not read spill file " << _table.spillFile());
+            if (_file)
+                std::fclose(_file);
+            _file = 0;
+        }
+        else {
+            if (_table.isQuantized())
+                _quantizedBuffer.resize(_maxChunkSize);
+            if (_header.hasIndexColumn)
+                _indexBuffer.resize(_maxChunkSize);
+        }
+    }
+    if (!_table.isResident() || _table.isQuantized() || _table.isView())
+        _columnBuffer.resize(_table.numColumns() * _maxChunkSize);
+    if (_table.isView())
+        _indexBuffer.resize(_maxChunkSize);
+}
+
+FeatureTableCursor::~FeatureTableCursor() {
+    if (_file)
+        std::fclose(_file);
+}
+
+bool FeatureTableCursor::next() {
+    _chunkBegin += _chunkSize;
+    if (_chunkBegin >= _table.size()) {
+        _chunkSize = 0;
+        return false;
+    }
+    _chunkSize = std::min(_maxChunkSize, _table.size() - _chunkBegin);
+
+    if (_table.isView()) {
+        gatherChunk();
+        return true;
+    }
+    else if (_table.isResident()) {
+		// For tables of floats in memory, the chunk just points into the columns
+        if (_table.isQuantized())
+            dequantizeChunk();
+        else {
+            for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m)
+                _columns[m] = _table.hasFeature(m) ? _table.column(m) + _chunkBegin : 0;
+        }
+        _indices = _table.hasIndexColumn() ? _table.indexColumn() + _chunkBegin : 0;
+        return true;
+    }
+    else
+        return readChunk();
+}
+
+void FeatureTableCursor::dequantizeChunk() {
+    int column = 0;
+    for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m) {
+        if (!_table.hasFeature(m))
+            continue;
+        float* buffer = &_columnBuffer[column * _maxChunkSize];
+        dequantizeValues(_table.quantizedColumn(m) + _chunkBegin, buffer, _chunkSize, _table.quantization(m));
+        _columns[m] = buffer;
+        ++column;
+    }
+}
+
+void FeatureTableCursor::gatherChunk() {
+	// The rows of a view are scattered over its source, so they are copied together
+    const FeatureTable& source = _table.storage();
+    for (size_t i = 0; i < _chunkSize; ++i, _rows.next())
+        _indexBuffer[i] = static_cast<uint64_t>(_rows.storageRow());
+
+    int column = 0;
+    for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m) {
+        if (!_table.hasFeature(m))
+            continue;
+        float* buffer = &_columnBuffer[column * _maxChunkSize];
+        for (size_t i = 0; i < _chunkSize; ++i)
+            buffer[i] = source.value(static_cast<size_t>(_indexBuffer[i]), m);
+        _columns[m] = buffer;
+        ++column;
+    }
+
+    for (size_t i = 0; i < _chunkSize; ++i)
+        _indexBuffer[i] = source.voxelIndex(static_cast<size_t>(_indexBuffer[i]));
+    _indices = &_indexBuffer[0];
+}
+
+bool FeatureTableCursor::readChunk() {
+    if (_file == 0)
+        return false;
+
+    int column = 0;
+    for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m) {
+        if (!_table.hasFeature(m))
+            continue;
+        float* buffer = &_columnBuffer[column * _maxChunkSize];
+        const uint64_t offset = _header.columnOffset(column) + _chunkBegin * _header.valueSize();
+        if (_table.isQuantized()) {
+            if (!seekTo(_file, offset)
+                || std::fread(&_quantizedBuffer[0], sizeof(uint16_t), _chunkSize, _file) != _chunkSize)
+            {
+                return false;
+            }
+            dequantizeValues(&_quantizedBuffer[0], buffer, _chunkSize, _table.quantization(m));
+        }
+        else if (!seekTo(_file, offset) || std::fread(buffer, sizeof(float), _chunkSize, _file) != _chunkSize)
+            return false;
+        _columns[m] = buffer;
+        ++column;
+    }
+
+    _indices = 0;
+    if (_header.hasIndexColumn) {
+        if (!seekTo(_file, _header.indexOffset() + _chunkBegin * sizeof(uint64_t))
+            || std::fread(&_indexBuffer[0], sizeof(uint64_t), _chunkSize, _file) != _chunkSize)
+        {
+            return false;
+        }
+        _indices = &_indexBuffer[0];
+    }
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,409 @@
+#include "modules/tnm093/include/tnm_featurekernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define TNM_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and clang only allow the use of intrinsics in functions that are compiled for the
+// matching instruction set. MSVC allows them everywhere
+#if defined(__GNUC__)
+#define TNM_TARGET(isa) __attribute__((target(isa)))
+#else
+#define TNM_TARGET(isa)
+#endif
+
+namespace voreen {
+
+namespace {
+
+	// The reference implementations, which are also used for the tail of a row that does not
+	// fill a whole vector
+
+	void computeAverageRowScalar(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+		for (size_t x = xBegin; x < xEnd; ++x)
+			output[x] = static_cast<float>(input.sum[x] * input.inverseCount);
+	}
+
+	void computeStdDeviationRowScalar(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+		for (size_t x = xBegin; x < xEnd; ++x) {
+			// sum((v - avg)^2) = sum(v^2) - 2*avg*sum(v) + n*avg^2 = sum(v^2) - avg*sum(v)
+			// The difference can drop slightly below zero due to rounding for non-integer data
+			const double sum = input.sum[x];
+			const double average = sum * input.inverseCount;
+			const double squaredDeviation = input.sumSquared[x] - sum * average;
+			output[x] = static_cast<float>(std::sqrt(std::max(squaredDeviation, 0.0)));
+		}
+	}
+
+	void computeGradientMagnitudeRowScalar(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+		for (size_t x = xBegin; x < xEnd; ++x) {
+			const float dx = (input.center[x+1] - input.center[x-1]) * 0.5f;
+			const float dy = (input.nextY[x] - input.previousY[x]) * 0.5f;
+			const float dz = (input.nextZ[x] - input.previousZ[x]) * 0.5f;
+			output[x] = std::sqrt(dx*dx + dy*dy + dz*dz);
+		}
+	}
+
+	// c * log2(c) for all counts a bin of the local histogram can reach
+	class CountLogTable {
+	public:
+		static const int MaxCount = (2 * MaxNeighbourhoodRadius + 1) * (2 * MaxNeighbourhoodRadius + 1)
+			* (2 * MaxNeighbourhoodRadius + 1);
+
+		CountLogTable() {
+			_values[0] = 0.0;
+			for (int c = 1; c <= MaxCount; ++c)
+				_values[c] = c * std::log(static_cast<double>(c)) / std::log(2.0);
+		}
+
+		double operator[](int count) const { return _values[count]; }
+
+	private:
+		double _values[MaxCount + 1];
+	};
+
+	// Initialized when the module is loaded, so the threads never race for it
+	const CountLogTable countLog2Count;
+
+	// Adds sign to the histogram bins of the (2*radius+1)^2 voxels in the column x of the neighbourhood
+	void updateHistogram(const FeatureRowInput& input, size_t x, int sign, int* counts) {
+		const long stride = static_cast<long>(input.rowStride);
+		for (int p = 0; p <= 2 * input.radius; ++p) {
+			for (long dy = -input.radius; dy <= input.radius; ++dy) {
+				const float v = input.planes[p][dy * stride + static_cast<long>(x)];
+				const int bin = static_cast<int>((v - input.binOffset) * input.binScale);
+				counts[std::min(std::max(bin, 0), LocalEntropyBins - 1)] += sign;
+			}
+		}
+	}
+	void convertToFloatScalar(const uint16_t* source, float* target, size_t n) {
+		for (size_t i = 0; i < n; ++i)
+			target[i] = source[i];
+	}
+
+#ifdef TNM_SIMD_X86
+	// The vector kernels perform exactly the same operations in the same order as the scalar
+	// kernel and only use correctly rounded instructions, so they produce identical results.
+	// _mm_max_pd(0, v) is used because, like std::max(v, 0.0), it returns v for v == -0.0
+
+	TNM_TARGET("sse4.1")
+	void computeAverageRowSSE41(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+		const __m128d inverseCount = _mm_set1_pd(input.inverseCount);
+		size_t x = xBegin;
+		for (; x + 4 <= xEnd; x += 4) {
+			const __m128 low = _mm_cvtpd_ps(_mm_mul_pd(_mm_loadu_pd(input.sum + x), inverseCount));
+			const __m128 high = _mm_cvtpd_ps(_mm_mul_pd(_mm_loadu_pd(input.sum + x + 2), inverseCount));
+			_mm_storeu_ps(output + x, _mm_movelh_ps(low, high));
+		}
+		computeAverageRowScalar(input, output, x, xEnd);
+	}
+
+	TNM_TARGET("sse4.1")
+	void computeStdDeviationRowSSE41(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+		const __m128d inverseCount = _mm_set1_pd(input.inverseCount);
+		const __m128d zero = _mm_setzero_pd();
+		size_t x = xBegin;
+		for (; x + 4 <= xEnd; x += 4) {
+			__m128 stdDeviation[2];
+			for (int i = 0; i < 2; ++i) {
+				const __m128d sum = _mm_loadu_pd(input.sum + x + 2*i);
+				const __m128d sumSquared = _mm_loadu_pd(input.sumSquared + x + 2*i);
+				const __m128d avg = _mm_mul_pd(sum, inverseCount);
+				const __m128d deviation = _mm_max_pd(zero, _mm_sub_pd(sumSquared, _mm_mul_pd(sum, avg)));
+				stdDeviation[i] = _mm_cvtpd_ps(_mm_sqrt_pd(deviation));
+			}
+			_mm_storeu_ps(output + x, _mm_movelh_ps(stdDeviation[0], stdDeviation[1]));
+		}
+		computeStdDeviationRowScalar(input, output, x, xEnd);
+	}
+
+	TNM_TARGET("sse4.1")
+	void computeGradientMagnitudeRowSSE41(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+		const __m128 half = _mm_set1_ps(0.5f);
+		size_t x = xBegin;
+		for (; x + 4 <= xEnd; x += 4) {
+			const __m128 dx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(input.center + x + 1),
+			                                        _mm_loadu_ps(input.center + x - 1)), half);
+			const __m128 dy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(input.nextY + x),
+			                                        _mm_loadu_ps(input.previousY + x)), half);
+			const __m128 dz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(input.nextZ + x),
+			                                        _mm_loadu_ps(input.previousZ + x)), half);
+			const __m128 squaredLength = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+			                                        _mm_mul_ps(dz, dz));
+			_mm_storeu_ps(output + x, _mm_sqrt_ps(squaredLength));
+		}
+		computeGradientMagnitudeRowScalar(input, output, x, xEnd);
+	}
+
+	TNM_TARGET("avx2")
+	void computeAverageRowAVX2(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+		const __m256d inverseCount = _mm256_set1_pd(input.inverseCount);
+		size_t x = xBegin;
+		for (; x + 8 <= xEnd; x += 8) {
+			for (int i = 0; i < 2; ++i) {
+				const __m256d avg = _mm256_mul_pd(_mm256_loadu_pd(input.sum + x + 4*i), inverseCount);
+				_mm_storeu_ps(output + x + 4*i, _mm256_cvtpd_ps(avg));
+			}
+		}
+		computeAverageRowScalar(input, output, x, xEnd);
+	}
+
+	TNM_TARGET("avx2")
+	void computeStdDeviationRowAVX2(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+		const __m256d inverseCount = _mm256_set1_pd(input.inverseCount);
+		const __m256d zero = _mm256_setzero_pd();
+		size_t x = xBegin;
+		for (; x + 8 <= xEnd; x += 8) {
+			for (int i = 0; i < 2; ++i) {
+				const __m256d sum = _mm256_loadu_pd(input.sum + x + 4*i);
+				const __m256d sumSquared = _mm256_loadu_pd(input.sumSquared + x + 4*i);
+				const __m256d avg = _mm256_mul_pd(sum, inverseCount);
+				const __m256d deviation = _mm256_max_pd(zero, _mm256_sub_pd(sumSquared, _mm256_mul_pd(sum, avg)));
+				_mm_storeu_ps(output + x + 4*i, _mm256_cvtpd_ps(_mm256_sqrt_pd(deviation)));
+			}
+		}
+		computeStdDeviationRowScalar(input, output, x, xEnd);
+	}
+
+	TNM_TARGET("avx2")
+	void computeGradientMagnitudeRowAVX2(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+		const __m256 half = _mm256_set1_ps(0.5f);
+		size_t x = xBegin;
+		for (; x + 8 <= xEnd; x += 8) {
+			const __m256 dx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(input.center + x + 1),
+			                                              _mm256_loadu_ps(input.center + x - 1)), half);
+			const __m256 dy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(input.nextY + x),
+			                                              _mm256_loadu_ps(input.previousY + x)), half);
+			const __m256 dz = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(input.nextZ + x),
+			                                              _mm256_loadu_ps(input.previousZ + x)), half);
+			const __m256 squaredLength = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+			                                           _mm256_mul_ps(dz, dz));
+			_mm256_storeu_ps(output + x, _mm256_sqrt_ps(squaredLength));
+		}
+		computeGradientMagnitudeRowScalar(input, output, x, xEnd);
+	}
+
+	TNM_TARGET("sse4.1")
+	void convertToFloatSSE41(const uint16_t* source, float* target, size_t n) {
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			const __m128i values = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i));
+			_mm_storeu_ps(target + i, _mm_cvtepi32_ps(_mm_cvtepu16_epi32(values)));
+		}
+		convertToFloatScalar(source + i, target + i, n - i);
+	}
+
+	TNM_TARGET("avx2")
+	void convertToFloatAVX2(const uint16_t* source, float* target, size_t n) {
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i));
+			_mm256_storeu_ps(target + i, _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(values)));
+		}
+		convertToFloatScalar(source + i, target + i, n - i);
+	}
+
+	SimdLevel detectSimdLevel() {
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+		__cpuid(info, 1);
+		const bool sse41 = (info[2] & (1 << 19)) != 0;
+		// AVX registers are only usable if the operating system saves them on a context switch
+		const bool osSavesAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+		bool avx2 = false;
+		if (maxLeaf >= 7 && osSavesAvx) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+#else
+		__builtin_cpu_init();
+		const bool sse41 = __builtin_cpu_supports("sse4.1") != 0;
+		const bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+		if (avx2)
+			return SimdLevelAVX2;
+		else if (sse41)
+			return SimdLevelSSE41;
+		else
+			return SimdLevelScalar;
+	}
+#else
+	SimdLevel detectSimdLevel() {
+		return SimdLevelScalar;
+	}
+#endif
+
+}
+
+SimdLevel featureKernelSimdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+void computeIntensityRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+    std::copy(input.center + xBegin, input.center + xEnd, output + xBegin);
+}
+
+void computeAverageRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+    switch (featureKernelSimdLevel()) {
+#ifdef TNM_SIMD_X86
+    case SimdLevelAVX2:
+        computeAverageRowAVX2(input, output, xBegin, xEnd);
+        break;
+    case SimdLevelSSE41:
+        computeAverageRowSSE41(input, output, xBegin, xEnd);
+        break;
+#endif
+    default:
+        computeAverageRowScalar(input, output, xBegin, xEnd);
+    }
+}
+
+void computeStdDeviationRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+    switch (featureKernelSimdLevel()) {
+#ifdef TNM_SIMD_X86
+    case SimdLevelAVX2:
+        computeStdDeviationRowAVX2(input, output, xBegin, xEnd);
+        break;
+    case SimdLevelSSE41:
+        computeStdDeviationRowSSE41(input, output, xBegin, xEnd);
+        break;
+#endif
+    default:
+        computeStdDeviationRowScalar(input, output, xBegin, xEnd);
+    }
+}
+
+void computeGradientMagnitudeRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+    switch (featureKernelSimdLevel()) {
+#ifdef TNM_SIMD_X86
+    case SimdLevelAVX2:
+        computeGradientMagnitudeRowAVX2(input, output, xBegin, xEnd);
+        break;
+    case SimdLevelSSE41:
+        computeGradientMagnitudeRowSSE41(input, output, xBegin, xEnd);
+        break;
+#endif
+    default:
+        computeGradientMagnitudeRowScalar(input, output, xBegin, xEnd);
+    }
+}
+
+void computeLaplacianRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+	// The sum of the second central differences along x, y and z
+    for (size_t x = xBegin; x < xEnd; ++x) {
+        const float neighbours = (input.center[x-1] + input.center[x+1]) + (input.previousY[x] + input.nextY[x])
+            + (input.previousZ[x] + input.nextZ[x]);
+        output[x] = neighbours - 6.f * input.center[x];
+    }
+}
+
+void computeLocalEntropyRow(const FeatureRowInput& input, float* output, size_t xBegin, size_t xEnd) {
+    if (xBegin >= xEnd)
+        return;
+
+    const size_t r = static_cast<size_t>(input.radius);
+    const int window = 2 * input.radius + 1;
+    const int count = window * window * window;
+    const double log2Count = std::log(static_cast<double>(count)) / std::log(2.0);
+
+	// Fill the histogram for the first voxel, then slide it along the row
+    int counts[LocalEntropyBins] = { 0 };
+    for (size_t x = xBegin - r; x <= xBegin + r; ++x)
+        updateHistogram(input, x, 1, counts);
+
+    for (size_t x = xBegin; x < xEnd; ++x) {
+        if (x > xBegin) {
+            updateHistogram(input, x + r, 1, counts);
+            updateHistogram(input, x - r - 1, -1, counts);
+        }
+		// -sum(p log2 p) with p = c/n is log2 n - sum(c log2 c)/n
+        double sum = 0.0;
+        for (int b = 0; b < LocalEntropyBins; ++b)
+            sum += countLog2Count[counts[b]];
+        output[x] = static_cast<float>(std::max(log2Count - sum / count, 0.0));
+    }
+}
+
+void convertToFloat(const uint16_t* source, float* target, size_t n) {
+    switch (featureKernelSimdLevel()) {
+#ifdef TNM_SIMD_X86
+    case SimdLevelAVX2:
+        convertToFloatAVX2(source, target, n);
+        break;
+    case SimdLevelSSE41:
+        convertToFloatSSE41(source, target, n);
+        break;
+#endif
+    default:
+        convertToFloatScalar(source, target, n);
+    }
+}
+
+void computeWindowSums(const float* plane, size_t dimX, size_t dimY, int radius,
+                       double* sum, double* sumSquared, double* rowSum, double* rowSumSquared)
+{
+    const size_t r = static_cast<size_t>(radius);
+    const size_t window = 2 * r + 1;
+    if (dimX < window || dimY < window)
+        return;
+
+	// First pass: a sliding window along each row
+    for (size_t y = 0; y < dimY; ++y) {
+        const float* row = plane + y * dimX;
+        double* outSum = rowSum + y * dimX;
+        double* outSumSquared = rowSumSquared + y * dimX;
+
+        double s = 0.0;
+        double sq = 0.0;
+        for (size_t x = 0; x < window; ++x) {
+            const double v = row[x];
+            s += v;
+            sq += v * v;
+        }
+        outSum[r] = s;
+        outSumSquared[r] = sq;
+
+        for (size_t x = r + 1; x < dimX - r; ++x) {
+            const double entering = row[x + r];
+            const double leaving = row[x - r - 1];
+            s += entering - leaving;
+            sq += entering * entering - leaving * leaving;
+            outSum[x] = s;
+            outSumSquared[x] = sq;
+        }
+    }
+
+	// Second pass: a sliding window along y over the row sums. The x loop is the inner one, so
+	// that whole rows are streamed through the cache
+    for (size_t x = r; x < dimX - r; ++x) {
+        sum[r * dimX + x] = 0.0;
+        sumSquared[r * dimX + x] = 0.0;
+    }
+    for (size_t y = 0; y < window; ++y) {
+        for (size_t x = r; x < dimX - r; ++x) {
+            sum[r * dimX + x] += rowSum[y * dimX + x];
+            sumSquared[r * dimX + x] += rowSumSquared[y * dimX + x];
+        }
+    }
+    for (size_t y = r + 1; y < dimY - r; ++y) {
+        const size_t entering = (y + r) * dimX;
+        const size_t leaving = (y - r - 1) * dimX;
+        for (size_t x = r; x < dimX - r; ++x) {
+            sum[y * dimX + x] = sum[(y-1) * dimX + x] + rowSum[entering + x] - rowSum[leaving + x];
+            sumSquared[y * dimX + x] = sumSquared[(y-1) * dimX + x]
+                + rowSumSquared[entering + x] - rowSumSquared[leaving + x];
+        }
+    }
+}
+
+} // namespace
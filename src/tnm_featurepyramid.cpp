@@ -0,0 +1,255 @@
+#include "modules/tnm093/include/tnm_featurepyramid.h"
+
+#include <algorithm>
+#include <limits>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+namespace voreen {
+
+double currentMilliseconds() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return 1000.0 * static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+#else
+    timeval time;
+    gettimeofday(&time, 0);
+    return 1000.0 * time.tv_sec + time.tv_usec / 1000.0;
+#endif
+}
+
+namespace {
+	// The number of blocks of 2 rows along an axis of n rows
+	size_t halved(size_t n) {
+		return (n + 1) / 2;
+	}
+}
+
+const size_t FeaturePyramid::MinimumLevelRows;
+
+FeaturePyramid::FeaturePyramid()
+    : _table(0)
+{
+    clear();
+}
+
+FeaturePyramid::~FeaturePyramid() {
+    clear();
+}
+
+void FeaturePyramid::clear() {
+    for (size_t i = 0; i < _levels.size(); ++i)
+        delete _levels[i];
+    _levels.clear();
+    _table = 0;
+    _dimensions = tgt::svec3(0, 0, 0);
+    for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m)
+        _ranges[m] = tgt::vec2(0.f, 0.f);
+}
+
+const FeatureTable& FeaturePyramid::level(size_t level) const {
+    return (level == 0) ? *_table : _levels[level - 1]->mean;
+}
+
+void FeaturePyramid::build(const FeatureTable& table, const tgt::svec3& dimensions, int nThreads) {
+    clear();
+    _table = &table;
+    _dimensions = dimensions;
+
+    std::vector<int> features;
+    for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m) {
+        if (table.hasFeature(m))
+            features.push_back(m);
+    }
+    const size_t nFeatures = features.size();
+
+    tgt::svec3 sourceDimensions = dimensions;
+    int shift = 0;
+    for (;;) {
+        const tgt::svec3 blocks(halved(sourceDimensions.x), halved(sourceDimensions.y), halved(sourceDimensions.z));
+        const size_t nBlocks = blocks.x * blocks.y * blocks.z;
+        if (nBlocks < MinimumLevelRows || nBlocks == sourceDimensions.x * sourceDimensions.y * sourceDimensions.z)
+            break;
+
+		// The level is aggregated from the level below. Level 0 counts one voxel per row and is its
+		// own minimum and maximum
+        const Level* source = _levels.empty() ? 0 : _levels.back();
+        const FeatureTable& sourceMean = source ? source->mean : table;
+        ++shift;
+
+        Level* level = new Level;
+        level->dimensions = blocks;
+        level->mean.resize(nBlocks, true, table.features());
+        level->minimum.resize(nBlocks, false, table.features());
+        level->maximum.resize(nBlocks, false, table.features());
+        level->counts.resize(nBlocks);
+        level->mean.setSortedByVoxelIndex(true);
+
+		// Different planes of blocks write different rows, so they can be aggregated concurrently
+#ifdef _OPENMP
+        #pragma omp parallel for num_threads(nThreads) schedule(dynamic, 1)
+#endif
+        for (long bz = 0; bz < static_cast<long>(blocks.z); ++bz) {
+            double sums[FeatureRegistry::MaxFeatures];
+            float minima[FeatureRegistry::MaxFeatures];
+            float maxima[FeatureRegistry::MaxFeatures];
+            for (size_t by = 0; by < blocks.y; ++by) {
+                for (size_t bx = 0; bx < blocks.x; ++bx) {
+                    for (size_t f = 0; f < nFeatures; ++f) {
+                        sums[f] = 0.0;
+                        minima[f] = std::numeric_limits<float>::max();
+                        maxima[f] = -std::numeric_limits<float>::max();
+                    }
+                    unsigned int count = 0;
+
+					// The blocks at the far end of an odd axis only have one row along it
+                    const size_t zEnd = std::min<size_t>(2 * bz + 2, sourceDimensions.z);
+                    const size_t yEnd = std::min<size_t>(2 * by + 2, sourceDimensions.y);
+                    const size_t xEnd = std::min<size_t>(2 * bx + 2, sourceDimensions.x);
+                    for (size_t z = 2 * bz; z < zEnd; ++z) {
+                        for (size_t y = 2 * by; y < yEnd; ++y) {
+                            for (size_t x = 2 * bx; x < xEnd; ++x) {
+                                const size_t row = (z * sourceDimensions.y + y) * sourceDimensions.x + x;
+                                const unsigned int weight = source ? source->counts[row] : 1;
+                                count += weight;
+                                for (size_t f = 0; f < nFeatures; ++f) {
+                                    const int m = features[f];
+                                    const float value = sourceMean.value(row, m);
+                                    sums[f] += static_cast<double>(weight) * value;
+                                    minima[f] = std::min(minima[f], source ? source->minimum.value(row, m) : value);
+                                    maxima[f] = std::max(maxima[f], source ? source->maximum.value(row, m) : value);
+                                }
+                            }
+                        }
+                    }
+
+                    const size_t block = (bz * blocks.y + by) * blocks.x + bx;
+                    for (size_t f = 0; f < nFeatures; ++f) {
+                        const int m = features[f];
+                        level->mean.column(m)[block] = static_cast<float>(sums[f] / count);
+                        level->minimum.column(m)[block] = minima[f];
+                        level->maximum.column(m)[block] = maxima[f];
+                    }
+                    level->counts[block] = count;
+					// The block stands for the voxel at its lower corner
+                    const size_t corner = (((bz << shift) * dimensions.y + (by << shift)) * dimensions.x) + (bx << shift);
+                    level->mean.indexColumn()[block] = static_cast<uint64_t>(corner);
+                }
+            }
+        }
+
+        _levels.push_back(level);
+        sourceDimensions = blocks;
+    }
+
+	// The coarsest level has the fewest rows to look at for the ranges
+    for (size_t f = 0; f < nFeatures; ++f) {
+        const int m = features[f];
+        const FeatureTable& minimum = _levels.empty() ? table : _levels.back()->minimum;
+        const FeatureTable& maximum = _levels.empty() ? table : _levels.back()->maximum;
+        tgt::vec2 range(std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+        for (size_t row = 0; row < minimum.size(); ++row) {
+            range.x = std::min(range.x, minimum.value(row, m));
+            range.y = std::max(range.y, maximum.value(row, m));
+        }
+        _ranges[m] = range;
+    }
+}
+
+void FeaturePyramid::buildFiltered(const FeaturePyramid& source, const FeatureTable& table) {
+    clear();
+    _table = &table;
+    _dimensions = source._dimensions;
+    for (int m = 0; m < FeatureRegistry::MaxFeatures; ++m)
+        _ranges[m] = source._ranges[m];
+    if (source._levels.empty())
+        return;
+
+	// The levels of a filtered source are views themselves, so the blocks are selected from the
+	// rows of their storage, which are the blocks of the whole volume
+    const size_t nLevels = source._levels.size();
+    std::vector<std::vector<uint64_t> > selections(nLevels);
+    for (size_t l = 0; l < nLevels; ++l)
+        selections[l].assign((source._levels[l]->mean.storage().size() + 63) / 64, 0);
+
+	// A single pass over the table marks the block of each of its voxels on every level
+    const FeatureTable& storage = table.storage();
+    const uint64_t planeSize = static_cast<uint64_t>(_dimensions.x) * _dimensions.y;
+    for (FeatureRowIterator it(table); !it.atEnd(); it.next()) {
+        const uint64_t voxel = storage.voxelIndex(it.storageRow());
+        const size_t x = static_cast<size_t>(voxel % _dimensions.x);
+        const size_t y = static_cast<size_t>((voxel / _dimensions.x) % _dimensions.y);
+        const size_t z = static_cast<size_t>(voxel / planeSize);
+        for (size_t l = 0; l < nLevels; ++l) {
+            const tgt::svec3& blocks = source._levels[l]->dimensions;
+            const size_t shift = l + 1;
+            const size_t block = ((z >> shift) * blocks.y + (y >> shift)) * blocks.x + (x >> shift);
+            selections[l][block / 64] |= uint64_t(1) << (block % 64);
+        }
+    }
+
+    for (size_t l = 0; l < nLevels; ++l) {
+        size_t nBlocks = 0;
+        for (size_t w = 0; w < selections[l].size(); ++w)
+            nBlocks += countBits(selections[l][w]);
+        if (nBlocks >= (_levels.empty() ? table.size() : _levels.back()->mean.size()))
+            continue;
+
+        const Level& sourceLevel = *source._levels[l];
+        Level* level = new Level;
+        level->dimensions = sourceLevel.dimensions;
+        std::vector<uint64_t> minimumSelection(selections[l]);
+        std::vector<uint64_t> maximumSelection(selections[l]);
+        level->minimum.attachView(sourceLevel.minimum.storage(), minimumSelection);
+        level->maximum.attachView(sourceLevel.maximum.storage(), maximumSelection);
+        level->mean.attachView(sourceLevel.mean.storage(), selections[l]);
+        _levels.push_back(level);
+    }
+}
+
+//
+// LevelOfDetailSelector
+//
+
+LevelOfDetailSelector::LevelOfDetailSelector()
+    : _millisecondsPerRow(0.0)
+    , _frameStart(0.0)
+{}
+
+const FeatureTable& LevelOfDetailSelector::select(const FeatureTable& table, float budgetMilliseconds,
+                                                  bool interacting) const
+{
+    const FeaturePyramid* pyramid = table.pyramid();
+    if (!interacting || pyramid == 0 || pyramid->numLevels() < 2 || _millisecondsPerRow <= 0.0)
+        return table;
+
+	// The finest level that can be drawn within the budget, or the coarsest if none can
+    const double maximumRows = budgetMilliseconds / _millisecondsPerRow;
+    for (size_t level = 0; level + 1 < pyramid->numLevels(); ++level) {
+        if (pyramid->level(level).size() <= maximumRows)
+            return pyramid->level(level);
+    }
+    return pyramid->level(pyramid->numLevels() - 1);
+}
+
+void LevelOfDetailSelector::beginFrame() {
+    _frameStart = currentMilliseconds();
+}
+
+void LevelOfDetailSelector::endFrame(size_t nRows) {
+    if (nRows == 0)
+        return;
+    const double perRow = (currentMilliseconds() - _frameStart) / nRows;
+	// Single frames vary a lot, so the estimate is smoothed over the last few
+    _millisecondsPerRow = (_millisecondsPerRow > 0.0) ? 0.5 * (_millisecondsPerRow + perRow) : perRow;
+}
+
+} // namespace
@@ -0,0 +1,115 @@
+#include "modules/tnm093/include/tnm_featureregistry.h"
+#include "modules/tnm093/include/tnm_featuretable.h"
+#include "voreen/core/processors/processor.h"
+
+#include <cmath>
+#include <sstream>
+
+namespace voreen {
+
+namespace {
+	// The ranges of the built-in measures
+
+	tgt::vec2 intensityRange(const tgt::vec2& intensities, int) {
+		return intensities;
+	}
+
+	tgt::vec2 stdDeviationRange(const tgt::vec2& intensities, int radius) {
+		// The squared deviations are summed up without dividing by the size of the neighbourhood.
+		// Each of them is at most the square of half the width of the range
+		const float windowSize = static_cast<float>(2 * radius + 1);
+		return tgt::vec2(0.f, std::sqrt(windowSize * windowSize * windowSize) * (intensities.y - intensities.x) / 2.f);
+	}
+
+	tgt::vec2 gradientMagnitudeRange(const tgt::vec2& intensities, int) {
+		// Each central difference is at most half the width of the range
+		return tgt::vec2(0.f, std::sqrt(3.f) * (intensities.y - intensities.x) / 2.f);
+	}
+
+	tgt::vec2 laplacianRange(const tgt::vec2& intensities, int) {
+		const float width = intensities.y - intensities.x;
+		return tgt::vec2(-6.f * width, 6.f * width);
+	}
+
+	tgt::vec2 localEntropyRange(const tgt::vec2&, int) {
+		return tgt::vec2(0.f, std::log(static_cast<float>(LocalEntropyBins)) / std::log(2.f));
+	}
+
+	bool isFeatureTableInport(const Port* port) {
+		return dynamic_cast<const FeatureTablePort*>(port) != 0;
+	}
+}
+
+const int FeatureRegistry::MaxFeatures;
+
+FeatureRegistry::FeatureRegistry() {
+	// The order has to match BuiltInFeature
+    const FeatureDescriptor builtIn[] = {
+        { "Intensity",          &computeIntensityRow,         &intensityRange,         0 },
+        { "Average",            &computeAverageRow,           &intensityRange,         FeatureDescriptor::RequiresWindowSums },
+        { "Standard Deviation", &computeStdDeviationRow,      &stdDeviationRange,      FeatureDescriptor::RequiresWindowSums },
+        { "Gradient Magnitude", &computeGradientMagnitudeRow, &gradientMagnitudeRange, 0 },
+        { "Laplacian",          &computeLaplacianRow,         &laplacianRange,         0 },
+        { "Local Entropy",      &computeLocalEntropyRow,      &localEntropyRange,      FeatureDescriptor::RequiresIntensityRange }
+    };
+    _features.assign(builtIn, builtIn + sizeof(builtIn) / sizeof(builtIn[0]));
+}
+
+FeatureRegistry& FeatureRegistry::instance() {
+    static FeatureRegistry registry;
+    return registry;
+}
+
+int FeatureRegistry::registerFeature(const FeatureDescriptor& descriptor) {
+    if (numFeatures() >= MaxFeatures)
+        return -1;
+    _features.push_back(descriptor);
+    return numFeatures() - 1;
+}
+
+int FeatureRegistry::requirements(FeatureSet features) const {
+    int result = 0;
+    for (int i = 0; i < numFeatures(); ++i) {
+        if (containsFeature(features, i))
+            result |= _features[i].requirements;
+    }
+    return result;
+}
+
+void FeatureRegistry::addOptions(IntOptionProperty& property) const {
+    for (int i = 0; i < numFeatures(); ++i) {
+        std::ostringstream key;
+        key << i;
+        property.addOption(key.str(), _features[i].name, i);
+    }
+}
+
+FeatureSet requestedFeatures(const Port& outport) {
+    if (outport.getConnected().empty())
+        return DefaultFeatures;
+
+    FeatureSet features = 0;
+    for (size_t i = 0; i < outport.getConnected().size(); ++i) {
+        const FeatureConsumer* consumer = dynamic_cast<const FeatureConsumer*>(outport.getConnected()[i]->getProcessor());
+        features |= consumer ? consumer->requestedFeatures() : DefaultFeatures;
+    }
+    return features;
+}
+
+void invalidateFeatureProducers(const Port& inport) {
+    for (size_t i = 0; i < inport.getConnected().size(); ++i) {
+        Processor* producer = inport.getConnected()[i]->getProcessor();
+        if (producer == 0)
+            continue;
+        producer->invalidate();
+
+		// Follow the FeatureTables further upstream
+        const std::vector<Port*>& inports = producer->getInports();
+        for (size_t j = 0; j < inports.size(); ++j) {
+            if (isFeatureTableInport(inports[j]))
+                invalidateFeatureProducers(*inports[j]);
+        }
+    }
+}
+
+} // namespace
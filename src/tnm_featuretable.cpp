@@ -0,0 +1,370 @@
+#include "modules/tnm093/include/tnm_featuretable.h"
+#include "modules/tnm093/include/tnm_featurefile.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+namespace voreen {
+
+namespace {
+	void* allocateAligned(size_t bytes, size_t alignment) {
+#ifdef _MSC_VER
+		void* p = _aligned_malloc(bytes, alignment);
+#else
+		void* p = 0;
+		if (posix_memalign(&p, alignment, bytes) != 0)
+			p = 0;
+#endif
+		if (p == 0)
+			throw std::bad_alloc();
+		return p;
+	}
+
+	void freeAligned(void* p) {
+#ifdef _MSC_VER
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+
+	// Rounds the number of bytes up to the next multiple of the column alignment
+	size_t paddedSize(size_t bytes) {
+		const size_t alignment = FeatureTable::ColumnAlignment;
+		return (bytes + alignment - 1) / alignment * alignment;
+	}
+}
+
+const size_t FeatureTable::ColumnAlignment;
+const size_t FeatureTable::RankBlockWords;
+const uint16_t FeatureTable::Quantization::MaxValue;
+
+FeatureTable::Quantization FeatureTable::Quantization::fromRange(float minimum, float maximum) {
+    Quantization quantization;
+    quantization.offset = minimum;
+	// An empty range maps everything to the minimum
+    quantization.scale = (maximum > minimum) ? (maximum - minimum) / MaxValue : 1.f;
+    return quantization;
+}
+
+void quantizeValues(const float* values, uint16_t* target, size_t n, const FeatureTable::Quantization& quantization) {
+    for (size_t i = 0; i < n; ++i)
+        target[i] = quantization.encode(values[i]);
+}
+
+void dequantizeValues(const uint16_t* values, float* target, size_t n, const FeatureTable::Quantization& quantization) {
+    for (size_t i = 0; i < n; ++i)
+        target[i] = quantization.decode(values[i]);
+}
+
+FeatureTable::FeatureTable()
+    : _size(0)
+    , _features(0)
+    , _format(StorageFloat32)
+    , _hasIndexColumn(false)
+    , _sortedByVoxelIndex(false)
+    , _storage(0)
+    , _capacity(0)
+    , _mappedFile(0)
+    , _pyramid(0)
+    , _indices(0)
+    , _viewSource(0)
+{
+    release();
+}
+
+FeatureTable::FeatureTable(size_t nRows, bool hasIndexColumn, FeatureSet features, StorageFormat format)
+    : _size(0)
+    , _features(0)
+    , _format(StorageFloat32)
+    , _hasIndexColumn(false)
+    , _sortedByVoxelIndex(false)
+    , _storage(0)
+    , _capacity(0)
+    , _mappedFile(0)
+    , _pyramid(0)
+    , _indices(0)
+    , _viewSource(0)
+{
+    resize(nRows, hasIndexColumn, features, format);
+}
+
+FeatureTable::~FeatureTable() {
+    release();
+}
+
+void FeatureTable::resize(size_t nRows, bool hasIndexColumn, FeatureSet features, StorageFormat format) {
+	// Keep the allocation out of the release, so that it can be reused
+    void* storage = _storage;
+    size_t capacity = _capacity;
+    _storage = 0;
+    _capacity = 0;
+    release();
+
+    const size_t nColumns = static_cast<size_t>(countFeatures(features));
+    const size_t valueBytes = (format == StorageUInt16) ? sizeof(uint16_t) : sizeof(float);
+    const size_t columnBytes = paddedSize(nRows * valueBytes);
+    const size_t indexBytes = hasIndexColumn ? paddedSize(nRows * sizeof(uint64_t)) : 0;
+    const size_t totalBytes = nColumns * columnBytes + indexBytes;
+
+    if (totalBytes > capacity) {
+        if (storage)
+            freeAligned(storage);
+        storage = allocateAligned(totalBytes, ColumnAlignment);
+        capacity = totalBytes;
+    }
+    _storage = storage;
+    _capacity = capacity;
+    _format = format;
+    if (nRows == 0)
+        return;
+
+	// The columns are laid out in the order of the measures' indices
+    char* base = static_cast<char*>(_storage);
+    size_t column = 0;
+    for (int i = 0; i < FeatureRegistry::MaxFeatures; ++i) {
+        if (containsFeature(features, i))
+            _columns[i] = base + (column++) * columnBytes;
+    }
+    if (hasIndexColumn)
+        _indices = reinterpret_cast<uint64_t*>(base + nColumns * columnBytes);
+    _size = nRows;
+    _features = features;
+    _hasIndexColumn = hasIndexColumn;
+}
+
+void FeatureTable::attachSpillFile(const std::string& path, size_t nRows, const FeatureTable& layout) {
+    release();
+    _spillFile = path;
+    _size = nRows;
+    _features = layout.features();
+    _format = layout.storageFormat();
+    _hasIndexColumn = layout.hasIndexColumn();
+    for (int i = 0; i < FeatureRegistry::MaxFeatures; ++i)
+        _quantization[i] = layout.quantization(i);
+}
+
+bool FeatureTable::mapCacheFile(const std::string& path, uint64_t cacheKey, FeatureSet requiredFeatures,
+                                StorageFormat format)
+{
+	// The table is only released once the file turned out to be usable, so that a miss keeps the
+	// columns for the extraction that follows it
+    MappedFile* file = new MappedFile;
+    if (!file->open(path) || file->size() < FeatureFileHeader::Size) {
+        delete file;
+        return false;
+    }
+
+    FeatureFileHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    const bool valid = std::memcmp(header.magic, "TNMF", 4) == 0
+        && header.version == FeatureFileHeader::CurrentVersion
+        && header.numColumns == static_cast<uint32_t>(countFeatures(header.features))
+        && (header.features & requiredFeatures) == requiredFeatures
+        && header.storageFormat == static_cast<uint32_t>(format)
+        && header.cacheKey == cacheKey
+        && header.fileSize() <= file->size();
+    if (!valid) {
+        delete file;
+        return false;
+    }
+
+    release();
+    char* base = static_cast<char*>(file->data());
+    const Quantization* quantization = reinterpret_cast<const Quantization*>(base + header.quantizationOffset());
+    int column = 0;
+    for (int i = 0; i < FeatureRegistry::MaxFeatures; ++i) {
+        if (!containsFeature(header.features, i))
+            continue;
+        if (format == StorageUInt16)
+            _quantization[i] = quantization[column];
+        _columns[i] = base + header.columnOffset(column++);
+    }
+    if (header.hasIndexColumn)
+        _indices = reinterpret_cast<uint64_t*>(base + header.indexOffset());
+    _size = static_cast<size_t>(header.numRows);
+    _features = header.features;
+    _format = format;
+    _hasIndexColumn = header.hasIndexColumn != 0;
+    _mappedFile = file;
+    return true;
+}
+
+void FeatureTable::attachView(const FeatureTable& source, std::vector<uint64_t>& selection) {
+    release();
+    _selection.swap(selection);
+    _selection.resize((source.size() + 63) / 64, 0);
+
+	// Counting the selected rows once per block of words makes finding a single row a binary search
+	// over the blocks followed by a scan of at most RankBlockWords words
+    _selectionRanks.reserve(_selection.size() / RankBlockWords + 1);
+    size_t count = 0;
+    for (size_t w = 0; w < _selection.size(); ++w) {
+        if (w % RankBlockWords == 0)
+            _selectionRanks.push_back(count);
+        count += countBits(_selection[w]);
+    }
+
+    _viewSource = &source;
+    _size = count;
+    _features = source.features();
+    _format = source.storageFormat();
+    _hasIndexColumn = source.hasIndexColumn();
+    for (int i = 0; i < FeatureRegistry::MaxFeatures; ++i)
+        _quantization[i] = source.quantization(i);
+}
+
+size_t FeatureTable::selectedRow(size_t row) const {
+	// The last block that starts with at most row selected rows before it contains the row
+    const size_t block = std::upper_bound(_selectionRanks.begin(), _selectionRanks.end(), row) - _selectionRanks.begin() - 1;
+    size_t remaining = row - _selectionRanks[block];
+    size_t w = block * RankBlockWords;
+    for (;;) {
+        const size_t n = countBits(_selection[w]);
+        if (remaining < n)
+            break;
+        remaining -= n;
+        ++w;
+    }
+    uint64_t bits = _selection[w];
+    for (size_t i = 0; i < remaining; ++i)
+        bits &= bits - 1;
+    return w * 64 + lowestBit(bits);
+}
+
+void FeatureTable::release() {
+    if (_storage)
+        freeAligned(_storage);
+    _storage = 0;
+    _capacity = 0;
+    delete _mappedFile;
+    _mappedFile = 0;
+    _pyramid = 0;
+    _size = 0;
+    _features = 0;
+    _format = StorageFloat32;
+    _hasIndexColumn = false;
+    _sortedByVoxelIndex = false;
+    _spillFile.clear();
+    _indices = 0;
+    _viewSource = 0;
+    std::vector<uint64_t>().swap(_selection);
+    std::vector<size_t>().swap(_selectionRanks);
+    const Quantization identity = { 0.f, 1.f };
+    for (int i = 0; i < FeatureRegistry::MaxFeatures; ++i) {
+        _columns[i] = 0;
+        _quantization[i] = identity;
+    }
+}
+
+FeatureRowIterator::FeatureRowIterator(const FeatureTable& table)
+    : _words((table.isView() && !table.selection().empty()) ? &table.selection()[0] : 0)
+    , _word(0)
+    , _bits(0)
+    , _size(table.size())
+    , _row(0)
+    , _storageRow(0)
+{
+    if (_words && _size > 0) {
+        _bits = _words[0];
+        findSetBit();
+    }
+}
+
+void FeatureRowIterator::next() {
+    ++_row;
+    if (!_words) {
+        _storageRow = _row;
+        return;
+    }
+    if (_row < _size)
+        findSetBit();
+}
+
+void FeatureRowIterator::findSetBit() {
+    while (_bits == 0)
+        _bits = _words[++_word];
+    _storageRow = _word * 64 + lowestBit(_bits);
+	// Clear the bit, so that the next call finds the next one
+    _bits &= _bits - 1;
+}
+
+VoxelRowMap::VoxelRowMap()
+    : _nRows(0)
+{}
+
+void VoxelRowMap::build(const FeatureTable& table) {
+    _nRows = table.size();
+    _rows.clear();
+    if (!table.hasIndexColumn() && !table.isView())
+        return;
+    const FeatureTable& storage = table.storage();
+    _rows.reserve(table.size());
+    for (FeatureRowIterator it(table); !it.atEnd(); it.next())
+        _rows.push_back(std::make_pair(storage.voxelIndex(it.storageRow()), it.row()));
+    if (!table.isSortedByVoxelIndex())
+        std::sort(_rows.begin(), _rows.end());
+}
+
+void VoxelRowMap::clear() {
+    _nRows = 0;
+    _rows.clear();
+}
+
+long VoxelRowMap::row(uint64_t voxel) const {
+    if (_rows.empty())
+        return (voxel < _nRows) ? static_cast<long>(voxel) : -1;
+    std::vector<std::pair<uint64_t, size_t> >::const_iterator i =
+        std::lower_bound(_rows.begin(), _rows.end(), std::make_pair(voxel, static_cast<size_t>(0)));
+    if (i == _rows.end() || i->first != voxel)
+        return -1;
+    return static_cast<long>(i->second);
+}
+
+FeatureTable* FeatureTable::createFromData(const Data& data) {
+	// An index column is only necessary if the rows are not the consecutive voxels
+    bool needsIndexColumn = false;
+    bool sorted = true;
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (data[i].voxelIndex != i)
+            needsIndexColumn = true;
+        if (i > 0 && data[i].voxelIndex < data[i-1].voxelIndex)
+            sorted = false;
+    }
+
+    FeatureTable* table = new FeatureTable(data.size(), needsIndexColumn, DefaultFeatures);
+    for (int m = 0; m < NUM_DATA_VALUES; ++m) {
+        float* column = table->column(m);
+        for (size_t i = 0; i < data.size(); ++i)
+            column[i] = data[i].dataValues[m];
+    }
+    if (needsIndexColumn) {
+        uint64_t* indices = table->indexColumn();
+        for (size_t i = 0; i < data.size(); ++i)
+            indices[i] = data[i].voxelIndex;
+        table->setSortedByVoxelIndex(sorted);
+    }
+    return table;
+}
+
+Data* FeatureTable::createData() const {
+    Data* data = new Data(_size);
+    FeatureTableCursor cursor(*this);
+    while (cursor.next()) {
+        for (size_t i = 0; i < cursor.chunkSize(); ++i) {
+            VoxelDataItem& item = (*data)[cursor.chunkBegin() + i];
+            item.voxelIndex = cursor.voxelIndex(i);
+            for (int m = 0; m < NUM_DATA_VALUES; ++m)
+                item.dataValues[m] = hasFeature(m) ? cursor.column(m)[i] : 0.f;
+        }
+    }
+    return data;
+}
+
+} // namespace
@@ -0,0 +1,22 @@
+#include "modules/tnm093/include/tnm_featuretabletodata.h"
+
+namespace voreen {
+
+TNMFeatureTableToData::TNMFeatureTableToData()
+    : Processor()
+    , _inport(Port::INPORT, "in.data")
+    , _outport(Port::OUTPORT, "out.data")
+{
+    addPort(_inport);
+    addPort(_outport);
+}
+
+void TNMFeatureTableToData::process() {
+    if (!_inport.hasData())
+        return;
+
+	// The new data is owned by the outport from now on
+    _outport.setData(_inport.getData()->createData());
+}
+
+} // namespace
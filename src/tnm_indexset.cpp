@@ -0,0 +1,390 @@
+#include "modules/tnm093/include/tnm_indexset.h"
+#include "modules/tnm093/include/tnm_bits.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace voreen {
+
+namespace {
+	// The ways in which two chunks can be combined
+	enum Operation {
+		Union = 0,
+		Intersection = 1,
+		Difference = 2
+	};
+
+	uint64_t upperBits(uint64_t index) {
+		return index >> 16;
+	}
+
+	uint16_t lowerBits(uint64_t index) {
+		return static_cast<uint16_t>(index & 0xffff);
+	}
+}
+
+const size_t IndexSet::MaxArraySize;
+const size_t IndexSet::BitmapWords;
+
+bool IndexSet::Chunk::contains(uint16_t value) const {
+    if (isBitmap())
+        return (words[value / 64] & (uint64_t(1) << (value % 64))) != 0;
+    return std::binary_search(values.begin(), values.end(), value);
+}
+
+void IndexSet::Chunk::normalize() {
+    if (isBitmap() && count <= MaxArraySize) {
+        std::vector<uint16_t> array;
+        array.reserve(count);
+        for (size_t w = 0; w < BitmapWords; ++w) {
+            for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1)
+                array.push_back(static_cast<uint16_t>(w * 64 + lowestBit(bits)));
+        }
+        values.swap(array);
+        std::vector<uint64_t>().swap(words);
+    }
+    else if (!isBitmap() && count > MaxArraySize) {
+        words.assign(BitmapWords, 0);
+        for (size_t i = 0; i < values.size(); ++i)
+            words[values[i] / 64] |= uint64_t(1) << (values[i] % 64);
+        std::vector<uint16_t>().swap(values);
+    }
+}
+
+IndexSet::IndexSet() {}
+
+IndexSet::IndexSet(const IndexSet& other)
+    : _chunks(other._chunks)
+{
+    for (size_t i = 0; i < _chunks.size(); ++i)
+        ++_chunks[i]->references;
+}
+
+IndexSet& IndexSet::operator=(const IndexSet& other) {
+	// Taking the references first makes assigning a set to itself safe
+    for (size_t i = 0; i < other._chunks.size(); ++i)
+        ++other._chunks[i]->references;
+    for (size_t i = 0; i < _chunks.size(); ++i)
+        release(_chunks[i]);
+    _chunks = other._chunks;
+    return *this;
+}
+
+IndexSet::~IndexSet() {
+    clear();
+}
+
+size_t IndexSet::size() const {
+    size_t count = 0;
+    for (size_t i = 0; i < _chunks.size(); ++i)
+        count += _chunks[i]->count;
+    return count;
+}
+
+size_t IndexSet::memoryUsage() const {
+    size_t bytes = _chunks.capacity() * sizeof(Chunk*);
+    for (size_t i = 0; i < _chunks.size(); ++i) {
+        const Chunk& chunk = *_chunks[i];
+        bytes += sizeof(Chunk) + chunk.values.capacity() * sizeof(uint16_t) + chunk.words.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+size_t IndexSet::findChunk(uint64_t key) const {
+    size_t first = 0;
+    size_t last = _chunks.size();
+    while (first < last) {
+        const size_t middle = (first + last) / 2;
+        if (_chunks[middle]->key < key)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return first;
+}
+
+bool IndexSet::contains(uint64_t index) const {
+    const size_t position = findChunk(upperBits(index));
+    return position < _chunks.size() && _chunks[position]->key == upperBits(index)
+        && _chunks[position]->contains(lowerBits(index));
+}
+
+IndexSet::Chunk* IndexSet::mutableChunk(size_t position) {
+    Chunk* chunk = _chunks[position];
+    if (chunk->references > 1) {
+        Chunk* copy = new Chunk(*chunk);
+        copy->references = 1;
+        --chunk->references;
+        _chunks[position] = copy;
+        chunk = copy;
+    }
+    return chunk;
+}
+
+void IndexSet::release(Chunk* chunk) {
+    if (--chunk->references == 0)
+        delete chunk;
+}
+
+void IndexSet::insert(uint64_t index) {
+    const uint64_t key = upperBits(index);
+    const uint16_t value = lowerBits(index);
+    const size_t position = findChunk(key);
+    if (position == _chunks.size() || _chunks[position]->key != key) {
+        Chunk* chunk = new Chunk;
+        chunk->references = 1;
+        chunk->key = key;
+        chunk->count = 1;
+        chunk->values.push_back(value);
+        _chunks.insert(_chunks.begin() + position, chunk);
+        return;
+    }
+    if (_chunks[position]->contains(value))
+        return;
+
+    Chunk* chunk = mutableChunk(position);
+    if (chunk->isBitmap())
+        chunk->words[value / 64] |= uint64_t(1) << (value % 64);
+    else
+        chunk->values.insert(std::lower_bound(chunk->values.begin(), chunk->values.end(), value), value);
+    ++chunk->count;
+    chunk->normalize();
+}
+
+void IndexSet::erase(uint64_t index) {
+    const uint64_t key = upperBits(index);
+    const uint16_t value = lowerBits(index);
+    const size_t position = findChunk(key);
+    if (position == _chunks.size() || _chunks[position]->key != key || !_chunks[position]->contains(value))
+        return;
+    if (_chunks[position]->count == 1) {
+        release(_chunks[position]);
+        _chunks.erase(_chunks.begin() + position);
+        return;
+    }
+
+    Chunk* chunk = mutableChunk(position);
+    if (chunk->isBitmap())
+        chunk->words[value / 64] &= ~(uint64_t(1) << (value % 64));
+    else
+        chunk->values.erase(std::lower_bound(chunk->values.begin(), chunk->values.end(), value));
+    --chunk->count;
+    chunk->normalize();
+}
+
+void IndexSet::clear() {
+    for (size_t i = 0; i < _chunks.size(); ++i)
+        release(_chunks[i]);
+    std::vector<Chunk*>().swap(_chunks);
+}
+
+IndexSet::Chunk* IndexSet::combine(const Chunk& first, const Chunk& second, int operation) {
+    Chunk* result = new Chunk;
+    result->references = 1;
+    result->key = first.key;
+
+	// Two arrays are merged directly; as soon as a bitmap is involved, both are combined as bitmaps
+    if (!first.isBitmap() && !second.isBitmap()) {
+        std::back_insert_iterator<std::vector<uint16_t> > output(result->values);
+        if (operation == Union)
+            std::set_union(first.values.begin(), first.values.end(), second.values.begin(), second.values.end(), output);
+        else if (operation == Intersection)
+            std::set_intersection(first.values.begin(), first.values.end(), second.values.begin(), second.values.end(), output);
+        else
+            std::set_difference(first.values.begin(), first.values.end(), second.values.begin(), second.values.end(), output);
+        result->count = result->values.size();
+    }
+    else {
+        std::vector<uint64_t> secondWords;
+        if (!second.isBitmap()) {
+            secondWords.assign(BitmapWords, 0);
+            for (size_t i = 0; i < second.values.size(); ++i)
+                secondWords[second.values[i] / 64] |= uint64_t(1) << (second.values[i] % 64);
+        }
+        const std::vector<uint64_t>& other = second.isBitmap() ? second.words : secondWords;
+
+        if (first.isBitmap())
+            result->words = first.words;
+        else {
+            result->words.assign(BitmapWords, 0);
+            for (size_t i = 0; i < first.values.size(); ++i)
+                result->words[first.values[i] / 64] |= uint64_t(1) << (first.values[i] % 64);
+        }
+
+        result->count = 0;
+        for (size_t w = 0; w < BitmapWords; ++w) {
+            if (operation == Union)
+                result->words[w] |= other[w];
+            else if (operation == Intersection)
+                result->words[w] &= other[w];
+            else
+                result->words[w] &= ~other[w];
+            result->count += countBits(result->words[w]);
+        }
+    }
+
+    if (result->count == 0) {
+        delete result;
+        return 0;
+    }
+    result->normalize();
+    return result;
+}
+
+IndexSet& IndexSet::operator|=(const IndexSet& other) {
+    if (&other == this)
+        return *this;
+
+    std::vector<Chunk*> chunks;
+    chunks.reserve(_chunks.size() + other._chunks.size());
+    size_t i = 0;
+    size_t j = 0;
+    while (i < _chunks.size() || j < other._chunks.size()) {
+        if (j == other._chunks.size() || (i < _chunks.size() && _chunks[i]->key < other._chunks[j]->key))
+            chunks.push_back(_chunks[i++]);
+        else if (i == _chunks.size() || other._chunks[j]->key < _chunks[i]->key) {
+			// Chunks that only the other set has are shared instead of copied
+            ++other._chunks[j]->references;
+            chunks.push_back(other._chunks[j++]);
+        }
+        else {
+            if (_chunks[i] == other._chunks[j])
+                chunks.push_back(_chunks[i]);
+            else {
+                chunks.push_back(combine(*_chunks[i], *other._chunks[j], Union));
+                release(_chunks[i]);
+            }
+            ++i;
+            ++j;
+        }
+    }
+    _chunks.swap(chunks);
+    return *this;
+}
+
+IndexSet& IndexSet::operator&=(const IndexSet& other) {
+    if (&other == this)
+        return *this;
+
+    std::vector<Chunk*> chunks;
+    size_t j = 0;
+    for (size_t i = 0; i < _chunks.size(); ++i) {
+        while (j < other._chunks.size() && other._chunks[j]->key < _chunks[i]->key)
+            ++j;
+        if (j == other._chunks.size() || other._chunks[j]->key != _chunks[i]->key)
+            release(_chunks[i]);
+        else if (_chunks[i] == other._chunks[j])
+            chunks.push_back(_chunks[i]);
+        else {
+            Chunk* chunk = combine(*_chunks[i], *other._chunks[j], Intersection);
+            if (chunk)
+                chunks.push_back(chunk);
+            release(_chunks[i]);
+        }
+    }
+    _chunks.swap(chunks);
+    return *this;
+}
+
+IndexSet& IndexSet::operator-=(const IndexSet& other) {
+    if (&other == this) {
+        clear();
+        return *this;
+    }
+
+    std::vector<Chunk*> chunks;
+    size_t j = 0;
+    for (size_t i = 0; i < _chunks.size(); ++i) {
+        while (j < other._chunks.size() && other._chunks[j]->key < _chunks[i]->key)
+            ++j;
+        if (j == other._chunks.size() || other._chunks[j]->key != _chunks[i]->key)
+            chunks.push_back(_chunks[i]);
+        else if (_chunks[i] == other._chunks[j])
+            release(_chunks[i]);
+        else {
+            Chunk* chunk = combine(*_chunks[i], *other._chunks[j], Difference);
+            if (chunk)
+                chunks.push_back(chunk);
+            release(_chunks[i]);
+        }
+    }
+    _chunks.swap(chunks);
+    return *this;
+}
+
+void IndexSet::changesSince(const IndexSet& previous, IndexSet& added, IndexSet& removed) const {
+    added = *this;
+    added -= previous;
+    removed = previous;
+    removed -= *this;
+}
+
+bool IndexSet::operator==(const IndexSet& other) const {
+    if (_chunks.size() != other._chunks.size())
+        return false;
+	// The representation of a chunk only depends on its count, so equal chunks store the same vectors
+    for (size_t i = 0; i < _chunks.size(); ++i) {
+        const Chunk& first = *_chunks[i];
+        const Chunk& second = *other._chunks[i];
+        if (&first == &second)
+            continue;
+        if (first.key != second.key || first.count != second.count || first.values != second.values
+            || first.words != second.words)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// IndexSet::const_iterator
+//
+
+IndexSet::const_iterator::const_iterator(const IndexSet* set, size_t chunk)
+    : _set(set)
+    , _chunk(chunk)
+    , _position(0)
+{
+    if (_chunk < _set->_chunks.size() && _set->_chunks[_chunk]->isBitmap())
+        findSetBit();
+}
+
+uint64_t IndexSet::const_iterator::operator*() const {
+    const Chunk& chunk = *_set->_chunks[_chunk];
+    const uint64_t value = chunk.isBitmap() ? static_cast<uint64_t>(_position) : chunk.values[_position];
+    return (chunk.key << 16) | value;
+}
+
+IndexSet::const_iterator& IndexSet::const_iterator::operator++() {
+    const Chunk& chunk = *_set->_chunks[_chunk];
+    ++_position;
+    if (chunk.isBitmap())
+        findSetBit();
+    else if (_position == chunk.values.size()) {
+        ++_chunk;
+        _position = 0;
+        if (_chunk < _set->_chunks.size() && _set->_chunks[_chunk]->isBitmap())
+            findSetBit();
+    }
+    return *this;
+}
+
+void IndexSet::const_iterator::findSetBit() {
+    const Chunk& chunk = *_set->_chunks[_chunk];
+    while (_position < 65536) {
+        const uint64_t bits = chunk.words[_position / 64] >> (_position % 64);
+        if (bits != 0) {
+            _position += lowestBit(bits);
+            return;
+        }
+        _position = (_position / 64 + 1) * 64;
+    }
+	// A chunk is never empty, so the next one starts with a set bit or an array value
+    ++_chunk;
+    _position = 0;
+    if (_chunk < _set->_chunks.size() && _set->_chunks[_chunk]->isBitmap())
+        findSetBit();
+}
+
+} // namespace
@@ -1,8 +1,55 @@
 
 #include "modules/tnm093/include/tnm_parallelcoordinates.h"
 
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
 namespace voreen {
 
+namespace {
+	// The number of bins of the histograms on the axes
+	const int NumHistogramBins = 64;
+
+	// The number of bins along each axis for the density of the rows between two axes
+	const int NumDensityBins = 64;
+
+	// How far from the cursor, in pixels, a line can be picked on the CPU
+	const float PickingTolerance = 3.f;
+
+	// In the automatic line mode, tables with more rows than this are drawn as a density
+	const size_t DensityRowThreshold = 1000000;
+
+	// The density bin of a normalized value in [-1,1]
+	int densityBin(float value) {
+		const int bin = static_cast<int>((value + 1.f) * 0.5f * NumDensityBins);
+		return std::min(NumDensityBins - 1, std::max(0, bin));
+	}
+
+	// The horizontal position of an axis in [-1,1]; a single axis sits in the middle
+	float axisPosition(size_t axis, size_t nAxes) {
+		return (nAxes > 1) ? -1.f + 2.f * axis / (nAxes - 1) : 0.f;
+	}
+
+	// The axis whose horizontal position is closest to x in [-1,1]
+	size_t nearestAxis(float x, size_t nAxes) {
+		if (nAxes < 2)
+			return 0;
+		const float position = (x + 1.f) * 0.5f * (nAxes - 1) + 0.5f;
+		return static_cast<size_t>(std::min(std::max(position, 0.f), static_cast<float>(nAxes - 1)));
+	}
+
+	// Draws the segments of the bound index buffer between each pair of neighbouring axes. The
+	// indices count from the first vertex of the left axis of the pair, whose vertices are the
+	// block of nRows vertices at the position of the pair in the bound vertex buffer
+	void drawAxisPairs(size_t nIndices, size_t nRows, size_t nAxes) {
+		for (size_t pair = 0; pair + 1 < nAxes; ++pair) {
+			glVertexPointer(2, GL_FLOAT, 0, reinterpret_cast<const GLvoid*>(pair * nRows * 2 * sizeof(float)));
+			glDrawElements(GL_LINES, static_cast<GLsizei>(nIndices), GL_UNSIGNED_INT, 0);
+		}
+	}
+}
+
 TNMParallelCoordinates::AxisHandle::AxisHandle(AxisHandlePosition location, int index, const tgt::vec2& position)
     : _location(location)
     , _index(index)
@@ -51,8 +98,36 @@ TNMParallelCoordinates::TNMParallelCoordinates()
     , _outport(Port::OUTPORT, "out.image")
     , _privatePort(Port::OUTPORT, "private.image", false, Processor::INVALID_RESULT, GL_RGBA32F)
     , _pickedHandle(-1)
-	, _brushingIndices("brushingIndices", "Brushing Indices")
+    , _draggedAxis(-1)
+    , _draggedAxisPosition(0.f)
+	// The brushing is computed during process(), which mustn't ask for yet another rendering
+	, _brushingIndices("brushingIndices", "Brushing Indices", Processor::VALID)
 	, _linkingIndices("linkingIndices", "Linking Indices")
+    , _frameBudget("frameBudget", "Frame Time Budget (ms)", 33.f, 1.f, 1000.f)
+    , _interacting("interacting", "Interacting", false)
+    , _latency("latency", "Handle Drag Latency (ms)", 0.f, 0.f, 10000.f, Processor::VALID)
+    , _averageLatency("averageLatency", "Average Handle Drag Latency (ms)", 0.f, 0.f, 10000.f, Processor::VALID)
+    , _mergedMoves("mergedMoves", "Merged Handle Moves", 0, 0, 1000000, Processor::VALID)
+    , _showHistograms("showHistograms", "Show Histograms", false)
+    , _lineMode("lineMode", "Line Mode")
+    , _cpuPicking("cpuPicking", "Pick Lines on the CPU", true)
+    , _savedAxisOrder("axisOrder", "Axis Order", "")
+    , _statisticsTable(0)
+    , _lineVertexBuffer(0)
+    , _linePickingBuffer(0)
+    , _visibleLineBuffer(0)
+    , _linkedLineBuffer(0)
+    , _nVisibleLineIndices(0)
+    , _nLinkedLineIndices(0)
+    , _lineTable(0)
+    , _lineIndicesValid(false)
+    , _densityValid(false)
+    , _segmentIndexValid(false)
+    , _hoveredRow(-1)
+    , _pendingHandle(-1)
+    , _pendingMoves(0)
+    , _pendingSince(0.0)
+    , _frameScheduled(false)
 {
     addPort(_inport);
     addPort(_outport);
@@ -60,6 +135,45 @@ TNMParallelCoordinates::TNMParallelCoordinates()
 
 	addProperty(_brushingIndices);
 	addProperty(_linkingIndices);
+    addProperty(_frameBudget);
+	// Link this to the property of the same name in the scatterplot
+    addProperty(_interacting);
+	// The latency of handle drags is only reported, not set
+    _latency.setWidgetsEnabled(false);
+    _averageLatency.setWidgetsEnabled(false);
+    _mergedMoves.setWidgetsEnabled(false);
+    addProperty(_latency);
+    addProperty(_averageLatency);
+    addProperty(_mergedMoves);
+    addProperty(_showHistograms);
+    _lineMode.addOption("lines", "Lines", LineModeLines);
+    _lineMode.addOption("density", "Density", LineModeDensity);
+    _lineMode.addOption("automatic", "Automatic", LineModeAutomatic);
+    _lineMode.selectByValue(LineModeAutomatic);
+    _lineMode.onChange(CallMemberAction<TNMParallelCoordinates>(this, &TNMParallelCoordinates::lineModeChanged));
+    addProperty(_lineMode);
+    addProperty(_cpuPicking);
+
+	// Every shown measure gets an axis and is requested from the producers; initially these are
+	// the default measures, in the order of the registry
+    const FeatureRegistry& registry = FeatureRegistry::instance();
+    for (int i = 0; i < registry.numFeatures(); ++i) {
+        std::ostringstream id;
+        id << "showAxis" << i + 1;
+        BoolProperty* show = new BoolProperty(id.str(), std::string("Show ") + registry.feature(i).name,
+                                              containsFeature(DefaultFeatures, i));
+        show->onChange(CallMemberAction<TNMParallelCoordinates>(this, &TNMParallelCoordinates::axisChanged));
+        addProperty(*show);
+        _showMeasures.push_back(show);
+    }
+    for (int i = 0; i < FeatureRegistry::MaxFeatures; ++i)
+        _axisOrder.push_back(i);
+	// The axes are ordered by dragging them, not through the property
+    _savedAxisOrder.setVisible(false);
+    _savedAxisOrder.onChange(CallMemberAction<TNMParallelCoordinates>(this, &TNMParallelCoordinates::axisOrderChanged));
+    addProperty(_savedAxisOrder);
+    _measureValues.resize(FeatureRegistry::MaxFeatures);
+    _brushIndices.resize(FeatureRegistry::MaxFeatures);
 
     _mouseClickEvent = new EventProperty<TNMParallelCoordinates>(
         "mouse.click", "Mouse Click",
@@ -83,37 +197,131 @@ TNMParallelCoordinates::TNMParallelCoordinates()
         tgt::MouseEvent::MOUSE_BUTTON_LEFT, tgt::MouseEvent::RELEASED, tgt::Event::MODIFIER_NONE);
     addEventProperty(_mouseReleaseEvent);
 
+    _mouseHoverEvent = new EventProperty<TNMParallelCoordinates>(
+        "mouse.hover", "Mouse Hover",
+        this, &TNMParallelCoordinates::handleMouseHover,
+        tgt::MouseEvent::MOUSE_BUTTON_NONE, tgt::MouseEvent::MOTION, tgt::Event::MODIFIER_NONE);
+    addEventProperty(_mouseHoverEvent);
+
 	//
     // Create AxisHandles here with a unique id
-    // _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionTop, 0, /* fix startposition */));
-    // ...
+	// Each measure has a pair of handles, which keep their place on its axis wherever the axis is
+	// drawn. Their horizontal position is set when the axes are laid out for a table
 	//
-    _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionTop, 0,tgt::vec2(-1,1)));
-    _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionBottom, 1,tgt::vec2(-1,-1)));
-    _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionTop, 2,tgt::vec2(-.33,1)));
-    _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionBottom, 3,tgt::vec2(-.33,-1)));
-    _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionTop, 4,tgt::vec2(.33,1)));
-    _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionBottom, 5,tgt::vec2(.33,-1)));
-    _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionTop, 6,tgt::vec2(1,1)));
-    _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionBottom, 7,tgt::vec2(1,-1)));
+    for (int i = 0; i < FeatureRegistry::MaxFeatures; ++i) {
+        _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionTop, 2 * i, tgt::vec2(0, 1)));
+        _handles.push_back(AxisHandle(AxisHandle::AxisHandlePositionBottom, 2 * i + 1, tgt::vec2(0, -1)));
+    }
 }
 
 TNMParallelCoordinates::~TNMParallelCoordinates() {
     delete _mouseClickEvent;
     delete _mouseMoveEvent;
+    delete _mouseHoverEvent;
+    for (size_t i = 0; i < _showMeasures.size(); ++i)
+        delete _showMeasures[i];
+}
+
+void TNMParallelCoordinates::deinitialize() throw (tgt::Exception) {
+    if (_lineVertexBuffer != 0) {
+        glDeleteBuffers(1, &_lineVertexBuffer);
+        glDeleteBuffers(1, &_linePickingBuffer);
+        glDeleteBuffers(1, &_visibleLineBuffer);
+        glDeleteBuffers(1, &_linkedLineBuffer);
+        _lineVertexBuffer = _linePickingBuffer = _visibleLineBuffer = _linkedLineBuffer = 0;
+    }
+    _lineTable = 0;
+    RenderProcessor::deinitialize();
+}
+
+FeatureSet TNMParallelCoordinates::requestedFeatures() const {
+    FeatureSet features = 0;
+    for (size_t i = 0; i < _showMeasures.size(); ++i) {
+        if (_showMeasures[i]->get())
+            features |= featureBit(static_cast<int>(i));
+    }
+    return features;
+}
+
+void TNMParallelCoordinates::axisChanged() {
+    if (_inport.hasData() && (_inport.getData()->features() & requestedFeatures()) != requestedFeatures())
+        invalidateFeatureProducers(_inport);
+}
+
+std::vector<int> TNMParallelCoordinates::axisMeasures(const FeatureTable& data) const {
+    std::vector<int> measures;
+    for (size_t i = 0; i < _axisOrder.size(); ++i) {
+        const int measure = _axisOrder[i];
+		// Shown measures are requested from the producers, but they are only in the table once it
+		// was computed again. Measures registered after this processor was created have no property
+		// and are always shown
+        const bool shown = measure >= static_cast<int>(_showMeasures.size()) || _showMeasures[measure]->get();
+        if (shown && data.hasFeature(measure))
+            measures.push_back(measure);
+    }
+    return measures;
+}
+
+void TNMParallelCoordinates::moveAxis(size_t from, size_t to) {
+    if (from >= _lineMeasures.size() || to >= _lineMeasures.size() || from == to)
+        return;
+	// The order also holds the measures without an axis, so the axis is put next to the one that
+	// is at its new position now: behind it when it moves to the right, in front of it otherwise
+    const int measure = _lineMeasures[from];
+    _axisOrder.erase(std::find(_axisOrder.begin(), _axisOrder.end(), measure));
+    std::vector<int>::iterator target = std::find(_axisOrder.begin(), _axisOrder.end(), _lineMeasures[to]);
+    _axisOrder.insert((to > from) ? target + 1 : target, measure);
+
+    std::ostringstream order;
+    for (size_t i = 0; i < _axisOrder.size(); ++i)
+        order << (i > 0 ? " " : "") << _axisOrder[i];
+    _savedAxisOrder.set(order.str());
+    invalidate();
+}
+
+void TNMParallelCoordinates::axisOrderChanged() {
+	// Measures that are missing from the saved order, or were saved more than once or with an
+	// invalid index, keep their place in the order of the registry behind the saved ones
+    std::vector<int> order;
+    std::vector<bool> used(FeatureRegistry::MaxFeatures, false);
+    std::istringstream saved(_savedAxisOrder.get());
+    int measure;
+    while (saved >> measure) {
+        if (measure >= 0 && measure < FeatureRegistry::MaxFeatures && !used[measure]) {
+            order.push_back(measure);
+            used[measure] = true;
+        }
+    }
+    for (int i = 0; i < FeatureRegistry::MaxFeatures; ++i) {
+        if (!used[i])
+            order.push_back(i);
+    }
+    _axisOrder.swap(order);
 }
 
 void TNMParallelCoordinates::process() {
+    _levelOfDetail.beginFrame();
+    _frameScheduled = false;
+    applyPendingMove();
+
 	// Activate the user-outport as the rendering target
     _outport.activateTarget();
 	// Clear the buffer
     _outport.clearTarget();
 
+	// Bring the vertex and index buffers of the lines up to date
+    updateLines();
+
 	// Render the handles
     renderHandles();
 	// Render the parallel coordinates lines
     renderAxisLines();
+    if (_showHistograms.get())
+        renderHistograms();
+    if (_densityValid)
+        renderDensity();
     renderLines();
+    renderHoveredLine();
     
 
 	// We are done with the visual part
@@ -125,25 +333,33 @@ void TNMParallelCoordinates::process() {
     _privatePort.clearTarget();
 	// Render the handles with the picking information encoded in the red channel
 	renderHandlesPicking();
-	// Render the lines with the picking information encoded in the green/blue/alpha channel
-	renderLinesPicking();
+	// Render the lines with the picking information encoded in the green/blue/alpha channel.
+	// Lines that are picked on the CPU don't need this second pass
+    if (!_cpuPicking.get())
+        renderLinesPicking();
 	// We are done with the private render target
     _privatePort.deactivateTarget();
+
+	// Both passes count towards the time of the frame
+    if (_inport.hasData())
+        _levelOfDetail.endFrame(_levelOfDetail.select(*_inport.getData(), _frameBudget.get(), _interacting.get()).size());
+    updateLatency();
 }
 
 void TNMParallelCoordinates::handleMouseClick(tgt::MouseEvent* e) {
 	// The picking texture is the result of the previous rendering in the private render port
     tgt::Texture* pickingTexture = _privatePort.getColorTexture();
-	// Retrieve the texture from the graphics memory and get it to the RAM
-	pickingTexture->downloadTexture();
 
 	// The texture coordinates are flipped in the y direction, so we take care of that here
     const tgt::ivec2 screenCoords = tgt::ivec2(e->coord().x, pickingTexture->getDimensions().y - e->coord().y);
 	// And then go from integer pixel coordinates to [-1,1] coordinates
     const tgt::vec2& normalizedDeviceCoordinates = (tgt::vec2(screenCoords) / tgt::vec2(_privatePort.getSize()) - 0.5f) * 2.f;
 
+	// Only the texel under the cursor is read back from the graphics memory
+    const tgt::vec4 texel = readPickingTexel(screenCoords);
+
 	// The picking information for the handles is stored in the red color channel
-    int handleId = static_cast<int>(pickingTexture->texelAsFloat(screenCoords).r * 255 - 1);
+    int handleId = static_cast<int>(texel.r * 255 - 1);
 
 //     LINFOC("Picking", "Picked handle index: " << handleId);
     // Use the 'id' and the 'normalizedDeviceCoordinates' to move the correct handle
@@ -153,25 +369,54 @@ void TNMParallelCoordinates::handleMouseClick(tgt::MouseEvent* e) {
     if(handleId != -1)
     {
         _pickedHandle = handleId;
+        // Dragging a handle is an interaction, during which the linked views may draw coarser levels
+        _interacting.set(true);
     }
     else
     {
         _pickedHandle = -1;
     }
 
+    // A left click on an axis, but not on one of its handles, grabs the axis, so that it can be
+    // dragged to another place among the axes
+    const size_t nAxes = _lineMeasures.size();
+    if(handleId == -1 && e->button() == tgt::MouseEvent::MOUSE_BUTTON_LEFT && nAxes > 1 && _privatePort.getSize().x > 0)
+    {
+        const size_t axis = nearestAxis(normalizedDeviceCoordinates.x, nAxes);
+        const float tolerance = PickingTolerance * 2.f / _privatePort.getSize().x;
+        if(std::abs(axisPosition(axis, nAxes) - normalizedDeviceCoordinates.x) <= tolerance)
+        {
+            _draggedAxis = static_cast<int>(axis);
+            _draggedAxisPosition = normalizedDeviceCoordinates.x;
+            return;
+        }
+    }
+
     int lineId = -1;
-    const Data& data = *(_inport.getData());
+    // The lines are the rows of the table that was drawn last, which may be a coarser level
+    const size_t nLines = _lineTable ? _lineTable->size() : 0;
     // Derive the id of the line that was clicked based on the color scheme that you devised in the
-    // renderLinesPicking method
-    //(0,voxelIndex%255,(voxelIndex+(255/3))%255,(voxelIndex+(2*255/3))%255);
-    lineId = static_cast<int>( pickingTexture->texelAsFloat(screenCoords).g * (data.size()*255) - 1);
+    // renderLinesPicking method: the row + 1, split into its lower and upper 16 bits in green and blue
+    if (_cpuPicking.get())
+    {
+      // The lines were not rendered for picking, so they are looked up in the segment index instead
+      lineId = static_cast<int>(pickLine(normalizedDeviceCoordinates));
+    }
+    else
+    {
+      const unsigned int pickedId = static_cast<unsigned int>(texel.g + 0.5f) | (static_cast<unsigned int>(texel.b + 0.5f) << 16);
+      lineId = static_cast<int>(pickedId) - 1;
+      if (lineId >= static_cast<int>(nLines))
+        lineId = -1;
+    }
     
     LINFOC("Picking", "Picked line index: " << lineId);
    
     if (lineId != -1)
     {
-      // We want to add it only if a line was clicked
-      _linkingList.insert(lineId);
+      // We want to add it only if a line was clicked. The linking names the voxel of the line, so
+      // that it stays the same line in every level of the table and in the other views
+      _linkingList.insert(_lineTable->storage().voxelIndex(_lineTable->storageRow(lineId)));
       LINFOC("insert", "done");
       
     }
@@ -186,6 +431,8 @@ void TNMParallelCoordinates::handleMouseClick(tgt::MouseEvent* e) {
 
     // Make the list of selected indices available to the Scatterplot
     _linkingIndices.set(_linkingList);
+    // The linked lines are drawn from a different index buffer
+    _lineIndicesValid = false;
 }
 
 void TNMParallelCoordinates::handleMouseMove(tgt::MouseEvent* e) {
@@ -225,174 +472,683 @@ void TNMParallelCoordinates::handleMouseMove(tgt::MouseEvent* e) {
             }
         }
 //         LINFOC("drag", "Dragging " << _pickedHandle << " with pair " << handlePair);
-        _handles.at(_pickedHandle).setPosition(newPosition);
-    }
+        // The move is applied when the next frame is rendered; further moves until then replace it
+        if (_pendingMoves == 0)
+            _pendingSince = currentMilliseconds();
+        ++_pendingMoves;
+        _pendingHandle = _pickedHandle;
+        _pendingHandlePosition = newPosition;
 
-	// update the _brushingList with the indices of the lines that are not rendered anymore
+        // This re-renders the scene (which will call process in turn). A frame that was already
+        // asked for shows the latest position anyway, so it isn't asked for again
+        if (!_frameScheduled)
+        {
+            _frameScheduled = true;
+            invalidate();
+        }
+    }
+    else if(_draggedAxis != -1)
+    {
+        // The dragged axis follows the cursor; the axes are only reordered once it is dropped
+        _draggedAxisPosition = normalizedDeviceCoordinates.x;
+        if (!_frameScheduled)
+        {
+            _frameScheduled = true;
+            invalidate();
+        }
+    }
+}
 
-	_brushingIndices.set(_brushingList);
+void TNMParallelCoordinates::applyPendingMove() {
+    if (_pendingHandle == -1)
+        return;
+	// Which lines are brushed is decided when the index buffers are filled, which is only
+	// necessary if the handle ended up somewhere else
+	// The handle only moves along its axis, which may have moved since
+    AxisHandle& handle = _handles.at(_pendingHandle);
+    if (handle._position.y != _pendingHandlePosition.y) {
+        handle.setPosition(tgt::vec2(handle._position.x, _pendingHandlePosition.y));
+        _lineIndicesValid = false;
+    }
+    _pendingHandle = -1;
+}
 
-    // This re-renders the scene (which will call process in turn)
-    invalidate();
+void TNMParallelCoordinates::updateLatency() {
+    if (_pendingMoves == 0)
+        return;
+    const float latency = static_cast<float>(currentMilliseconds() - _pendingSince);
+    _latency.set(latency);
+	// Single frames vary a lot, so the average is smoothed over the last few
+    _averageLatency.set((_averageLatency.get() > 0.f) ? 0.5f * (_averageLatency.get() + latency) : latency);
+    _mergedMoves.set(_pendingMoves);
+    _pendingMoves = 0;
 }
 
 void TNMParallelCoordinates::handleMouseRelease(tgt::MouseEvent* e) {
     _pickedHandle = -1;
+    _frameScheduled = false;
+    // A dragged axis is dropped at the place closest to where it was released
+    if(_draggedAxis != -1)
+    {
+        moveAxis(static_cast<size_t>(_draggedAxis), nearestAxis(_draggedAxisPosition, _lineMeasures.size()));
+        _draggedAxis = -1;
+        invalidate();
+    }
+    // Once the interaction stops, all views refine to the full table
+    if(_interacting.get())
+    {
+      _interacting.set(false);
+      invalidate();
+    }
+}
+
+void TNMParallelCoordinates::handleMouseHover(tgt::MouseEvent* e) {
+    if (!_cpuPicking.get())
+        return;
+    const tgt::ivec2 screenCoords = tgt::ivec2(e->coord().x, _privatePort.getSize().y - e->coord().y);
+    const tgt::vec2 normalizedDeviceCoordinates = (tgt::vec2(screenCoords) / tgt::vec2(_privatePort.getSize()) - 0.5f) * 2.f;
+
+	// Only a change of the row under the cursor is worth a new rendering
+    const long row = pickLine(normalizedDeviceCoordinates);
+    if (row != _hoveredRow) {
+        _hoveredRow = row;
+        invalidate();
+    }
+}
+
+long TNMParallelCoordinates::pickLine(const tgt::vec2& normalizedDeviceCoordinates) const {
+    if (_lineTable == 0 || !_segmentIndexValid || _privatePort.getSize().y <= 0)
+        return -1;
+    const float tolerance = PickingTolerance * 2.f / _privatePort.getSize().y;
+    return _segmentIndex.findNearest(normalizedDeviceCoordinates, tolerance, _visibleRows);
 }
 
 void TNMParallelCoordinates::renderAxisLines()
 {
+  const size_t nAxes = _lineMeasures.size();
   glBegin(GL_LINES);
   glColor3f(1,1,1);
-  glVertex2f(-0.33, -1);
-  glVertex2f(-0.33, 1);
-  glVertex2f(0.33, -1);
-  glVertex2f(0.33, 1);
+  for(size_t axis = 0; axis < nAxes; ++axis)
+  {
+    if(static_cast<int>(axis) == _draggedAxis)
+      continue;
+    glVertex2f(axisPosition(axis, nAxes), -1);
+    glVertex2f(axisPosition(axis, nAxes), 1);
+  }
+  // The dragged axis is drawn where the cursor is until it is dropped
+  if(_draggedAxis != -1)
+  {
+    glColor3f(1,1,0);
+    glVertex2f(_draggedAxisPosition, -1);
+    glVertex2f(_draggedAxisPosition, 1);
+  }
   glEnd();
 }
 
 
-void TNMParallelCoordinates::renderLines(bool picking)
+void TNMParallelCoordinates::updateLines() {
+    const FeatureTable* data = 0;
+    if (_inport.hasData()) {
+        const FeatureTable& table = *(_inport.getData());
+		// Tables that were spilled to disk have to be reduced by a TNMDataReduction first
+        if (!table.isResident())
+            LWARNINGC("TNMParallelCoordinates", "The data was spilled to disk and has to be reduced before plotting");
+		// If a shown measure is missing, the table is still being computed with it. Until then,
+		// the axes of the measures the table has are drawn
+        else if (!table.empty()) {
+			// While a handle is dragged, a coarser level of the table is drawn if the full table
+			// doesn't fit into the frame time budget
+            data = &_levelOfDetail.select(table, _frameBudget.get(), _interacting.get());
+        }
+    }
+	// The statistics belong to the table on the inport and are only computed again for a new one
+    if (_inport.hasChanged() || _inport.getData() != _statisticsTable) {
+        _statistics.assign(FeatureRegistry::MaxFeatures, MeasureStatistics());
+        _statisticsTable = _inport.getData();
+    }
+
+    if (data == 0) {
+        _lineTable = 0;
+        _nVisibleLineIndices = 0;
+        _nLinkedLineIndices = 0;
+        return;
+    }
+
+    if (data != _lineTable || _inport.hasChanged())
+        resetLines(*data);
+    const std::vector<int> measures = axisMeasures(*data);
+    if (measures != _lineMeasures)
+        updateAxes(*data, measures);
+    if (!_lineIndicesValid)
+        updateLineIndices(*data);
+
+	// The segment index is only needed, and only worth its memory, if the lines are picked on the CPU.
+	// After a change of the axes, only the gaps next to the changed axes are indexed again
+    if (_cpuPicking.get() && !_segmentIndexValid) {
+        _segmentIndex.update(axisValues(), data->size());
+        _segmentIndexValid = true;
+    }
+    else if (!_cpuPicking.get() && _segmentIndexValid) {
+        _segmentIndex.clear();
+        _segmentIndexValid = false;
+    }
+}
+
+const TNMParallelCoordinates::MeasureStatistics& TNMParallelCoordinates::measureStatistics(int measure,
+                                                                                            bool withHistogram)
 {
-  LINFOC("draw" , "drawing");
-  //
-  // Implement your line drawing
-  //
-  if(!_inport.hasData())
-    return;
-  
-  const Data& data = *(_inport.getData());
+    const FeatureTable& table = *(_inport.getData());
+    const FeatureTable& storage = table.storage();
+    MeasureStatistics& statistics = _statistics[measure];
+
+    if (!statistics.hasRange) {
+		// The pyramid knows the range of the whole table, which also keeps the axes in place when the level changes
+        if (table.pyramid()) {
+            statistics.minimum = table.pyramid()->range(measure).x;
+            statistics.maximum = table.pyramid()->range(measure).y;
+        }
+		// Otherwise the range is found with a pass over a single column
+        else {
+            FeatureRowIterator it(table);
+            statistics.minimum = statistics.maximum = storage.value(it.storageRow(), measure);
+            for (it.next(); !it.atEnd(); it.next()) {
+                const float value = storage.value(it.storageRow(), measure);
+                statistics.minimum = std::min(statistics.minimum, value);
+                statistics.maximum = std::max(statistics.maximum, value);
+            }
+        }
+        statistics.hasRange = true;
+    }
+
+    if (withHistogram && statistics.histogram.empty()) {
+        statistics.histogram.resize(NumHistogramBins, 0);
+        const float range = statistics.maximum - statistics.minimum;
+        const float binScale = (range > 0.f) ? NumHistogramBins / range : 0.f;
+        for (FeatureRowIterator it(table); !it.atEnd(); it.next()) {
+            const float bin = (storage.value(it.storageRow(), measure) - statistics.minimum) * binScale;
+            ++statistics.histogram[std::min(NumHistogramBins - 1, std::max(0, static_cast<int>(bin)))];
+        }
+    }
+    return statistics;
+}
 
-  float maxIntensity = data[0].dataValues[0];
-  float minIntensity = data[0].dataValues[0];
+void TNMParallelCoordinates::resetLines(const FeatureTable& data) {
+	// The values and indices belong to the previous table
+    for (size_t i = 0; i < _measureValues.size(); ++i) {
+        std::vector<float>().swap(_measureValues[i]);
+        _brushIndices[i].clear();
+    }
+    _segmentIndex.clear();
+    std::vector<uint64_t>().swap(_visibleRows);
+	// The linking names voxels, which have different rows in each table
+    _lineVoxelRows.build(data);
 
-  float maxAvg = data[0].dataValues[1];
-  float minAvg = data[0].dataValues[1];
+	// The vertex buffer has room for a block of vertices for every column of the table, so that
+	// showing or hiding an axis doesn't have to allocate it again. The picking color encodes the
+	// row + 1 exactly: the lower 16 bits in the green and the upper 16 bits in the blue channel,
+	// each as a whole number. It is the same in both blocks the indices of a segment refer to
+    const size_t nRows = data.size();
+    _vertexBlockMeasures.assign(countFeatures(data.features()), -1);
+    std::vector<float> pickingColors(2 * nRows * 3, 0.f);
+    for (size_t row = 0; row < nRows; ++row) {
+        const uint32_t pickingId = static_cast<uint32_t>(row + 1);
+        for (size_t block = 0; block < 2; ++block) {
+            const size_t vertex = block * nRows + row;
+            pickingColors[3 * vertex + 1] = static_cast<float>(pickingId & 0xffff);
+            pickingColors[3 * vertex + 2] = static_cast<float>(pickingId >> 16);
+        }
+    }
 
-  float maxStdDev = data[0].dataValues[2];
-  float minStdDev = data[0].dataValues[2];
+    if (_lineVertexBuffer == 0) {
+        glGenBuffers(1, &_lineVertexBuffer);
+        glGenBuffers(1, &_linePickingBuffer);
+        glGenBuffers(1, &_visibleLineBuffer);
+        glGenBuffers(1, &_linkedLineBuffer);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, _lineVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, _vertexBlockMeasures.size() * nRows * 2 * sizeof(float), 0, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, _linePickingBuffer);
+    glBufferData(GL_ARRAY_BUFFER, pickingColors.size() * sizeof(float), pickingColors.empty() ? 0 : &pickingColors[0],
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-  float maxGrad = data[0].dataValues[3];
-  float minGrad = data[0].dataValues[3];
+    _lineTable = &data;
+    _lineMeasures.clear();
+    _lineIndicesValid = false;
+    _densityValid = false;
+    _segmentIndexValid = false;
+    _hoveredRow = -1;
+}
+
+void TNMParallelCoordinates::updateAxes(const FeatureTable& data, const std::vector<int>& measures) {
+    const size_t nRows = data.size();
+    const size_t nAxes = measures.size();
 
-  for(int i = 0; i < data.size(); i++)
+	// Only the blocks of the axes whose measure changed are filled again. A vertex lies at x = axis,
+	// which renderLines maps to the place of the axis
+    std::vector<float> vertices;
+    glBindBuffer(GL_ARRAY_BUFFER, _lineVertexBuffer);
+    for (size_t axis = 0; axis < nAxes; ++axis) {
+        if (_vertexBlockMeasures[axis] == measures[axis])
+            continue;
+        const std::vector<float>& values = measureValues(data, measures[axis]);
+        vertices.resize(nRows * 2);
+        for (size_t row = 0; row < nRows; ++row) {
+            vertices[2 * row] = static_cast<float>(axis);
+            vertices[2 * row + 1] = values[row];
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, axis * nRows * 2 * sizeof(float), vertices.size() * sizeof(float), &vertices[0]);
+        _vertexBlockMeasures[axis] = measures[axis];
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// The handles move with their axes
+    for (size_t axis = 0; axis < nAxes; ++axis) {
+        const float x = axisPosition(axis, nAxes);
+        _handles.at(2 * measures[axis])._position.x = x;
+        _handles.at(2 * measures[axis] + 1)._position.x = x;
+    }
+
+	// Which rows are visible only depends on the set of axes, not on their order. The index
+	// buffers don't depend on the axes at all
+    std::vector<int> previousSet(_lineMeasures);
+    std::vector<int> set(measures);
+    std::sort(previousSet.begin(), previousSet.end());
+    std::sort(set.begin(), set.end());
+    if (set != previousSet)
+        _lineIndicesValid = false;
+    _lineMeasures = measures;
+    _segmentIndexValid = false;
+
+	// The density between two axes that were neighbours before is kept; the other pairs are
+	// counted for the rows that were visible so far, and updateLineIndices patches them together
+	// with the rest if that changes
+    if (_densityValid) {
+        const size_t pairBins = NumDensityBins * NumDensityBins;
+        const size_t nPairs = (nAxes > 0) ? nAxes - 1 : 0;
+        std::vector<unsigned int> density(nPairs * pairBins, 0);
+        std::vector<size_t> newPairs;
+        for (size_t pair = 0; pair < nPairs; ++pair) {
+            size_t old = 0;
+            while (old + 1 < _densityMeasures.size()
+                   && (_densityMeasures[old] != measures[pair] || _densityMeasures[old + 1] != measures[pair + 1]))
+                ++old;
+            if (old + 1 < _densityMeasures.size())
+                std::copy(_density.begin() + old * pairBins, _density.begin() + (old + 1) * pairBins, density.begin() + pair * pairBins);
+            else
+                newPairs.push_back(pair);
+        }
+        _density.swap(density);
+        _densityMeasures = measures;
+        countDensity(newPairs);
+    }
+}
+
+const std::vector<float>& TNMParallelCoordinates::measureValues(const FeatureTable& data, int measure) {
+    std::vector<float>& values = _measureValues[measure];
+    if (!values.empty() || data.empty())
+        return values;
+
+	// The values are read from the table that holds them, which for a view is the table it refers to
+    const FeatureTable& storage = data.storage();
+    const MeasureStatistics& statistics = measureStatistics(measure, false);
+    const float minimum = statistics.minimum;
+    const float range = statistics.maximum - statistics.minimum;
+    values.resize(data.size());
+    for (FeatureRowIterator it(data); !it.atEnd(); it.next())
+        values[it.row()] = (range > 0.f) ? -1.f + (storage.value(it.storageRow(), measure) - minimum) * 2.f / range : 0.f;
+
+	// The brushing works on the normalized values, which all lie in [-1,1]
+    _brushIndices[measure].build(&values[0], data.size(), 1, -1.f, 1.f);
+    return values;
+}
+
+std::vector<const float*> TNMParallelCoordinates::axisValues() const {
+    std::vector<const float*> values(_lineMeasures.size());
+    for (size_t axis = 0; axis < values.size(); ++axis)
+        values[axis] = &_measureValues[_lineMeasures[axis]][0];
+    return values;
+}
+
+void TNMParallelCoordinates::updateLineIndices(const FeatureTable& data) {
+    const FeatureTable& storage = data.storage();
+    const size_t nAxes = _lineMeasures.size();
+    const size_t nRows = data.size();
+
+	// A row is visible unless one of its values lies outside of the handles of the axis. The
+	// handles 2*m and 2*m+1 are the top and bottom handle of the axis of measure m
+    std::vector<uint64_t> visible((nRows + 63) / 64, ~uint64_t(0));
+    if (nRows % 64 != 0)
+        visible.back() = (uint64_t(1) << (nRows % 64)) - 1;
+    for (size_t axis = 0; axis < nAxes; ++axis) {
+        const int measure = _lineMeasures[axis];
+        const float lower = _handles.at(2 * measure + 1)._position.y;
+        const float upper = _handles.at(2 * measure)._position.y;
+        _brushIndices[measure].narrow(&lower, &upper, visible);
+    }
+
+	// The density can be patched with the same rows as the brushed voxels, if it is up to date
+    const bool density = drawsDensity(data);
+    const bool patchDensity = density && _densityValid && _visibleRows.size() == visible.size();
+
+	// Only the rows that became visible or hidden since the last time change the brushed voxels
+    if (_visibleRows.size() != visible.size()) {
+        for (FeatureRowIterator it(data); !it.atEnd(); it.next()) {
+            if (visible[it.row() / 64] & (uint64_t(1) << (it.row() % 64)))
+                _brushingList.erase(storage.voxelIndex(it.storageRow()));
+            else
+                _brushingList.insert(storage.voxelIndex(it.storageRow()));
+        }
+    }
+    else {
+        const std::vector<const float*> values = axisValues();
+        for (size_t w = 0; w < visible.size(); ++w) {
+            for (uint64_t changed = visible[w] ^ _visibleRows[w]; changed != 0; changed &= changed - 1) {
+                const size_t row = w * 64 + lowestBit(changed);
+                const uint64_t voxel = storage.voxelIndex(data.storageRow(row));
+                const bool isVisible = (visible[w] & (uint64_t(1) << (row % 64))) != 0;
+                if (isVisible)
+                    _brushingList.erase(voxel);
+                else
+                    _brushingList.insert(voxel);
+                if (patchDensity)
+                    updateDensity(values, row, isVisible);
+            }
+        }
+    }
+    _visibleRows.swap(visible);
+	// Make the voxels that are not rendered anymore available to the Scatterplot
+    _brushingIndices.set(_brushingList);
+    if (density && !patchDensity)
+        buildDensity();
+    _densityValid = density;
+
+	// A row is drawn as the segments between its vertices on neighbouring axes. The linked rows
+	// are drawn once more on top. With the density, only the linked rows are drawn as lines. The
+	// indices of a segment are the same for every pair of axes; renderLines moves them to the pair
+    const bool hasSegments = nAxes > 1;
+    size_t nVisible = 0;
+    for (size_t w = 0; w < _visibleRows.size() && !density && hasSegments; ++w)
+        nVisible += countBits(_visibleRows[w]);
+    std::vector<GLuint> visibleIndices(nVisible * 2);
+    size_t next = 0;
+    for (size_t w = 0; w < _visibleRows.size() && !density && hasSegments; ++w) {
+        for (uint64_t bits = _visibleRows[w]; bits != 0; bits &= bits - 1) {
+            const GLuint row = static_cast<GLuint>(w * 64 + lowestBit(bits));
+            visibleIndices[next++] = row;
+            visibleIndices[next++] = static_cast<GLuint>(nRows) + row;
+        }
+    }
+    std::vector<GLuint> linkedIndices;
+    for (IndexSet::const_iterator i = _linkingList.begin(); i != _linkingList.end() && hasSegments; ++i) {
+		// Coarser levels of the table don't have a row for every linked voxel
+        const long row = _lineVoxelRows.row(*i);
+        if (row < 0 || !(_visibleRows[row / 64] & (uint64_t(1) << (row % 64))))
+            continue;
+        linkedIndices.push_back(static_cast<GLuint>(row));
+        linkedIndices.push_back(static_cast<GLuint>(nRows + row));
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _visibleLineBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, visibleIndices.size() * sizeof(GLuint),
+                 visibleIndices.empty() ? 0 : &visibleIndices[0], GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _linkedLineBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, linkedIndices.size() * sizeof(GLuint),
+                 linkedIndices.empty() ? 0 : &linkedIndices[0], GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    _nVisibleLineIndices = visibleIndices.size();
+    _nLinkedLineIndices = linkedIndices.size();
+    _lineIndicesValid = true;
+}
+
+void TNMParallelCoordinates::renderLines(bool picking)
+{
+  // The geometry was prepared by updateLines, so all lines are drawn with at most two draw calls
+  // per pair of neighbouring axes
+  const size_t nAxes = _lineMeasures.size();
+  if(_lineTable == 0 || nAxes < 2 || _nVisibleLineIndices + _nLinkedLineIndices == 0)
+    return;
+  const size_t nRows = _lineTable->size();
+
+  // The vertices of an axis lie at x = axis, which is mapped to the place of the axis in [-1,1]
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glTranslatef(-1.f, 0.f, 0.f);
+  glScalef(2.f / (nAxes - 1), 1.f, 1.f);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  if(picking)
   {
-    const float intensityVal= data[i].dataValues[0];
-    const float avgVal= data[i].dataValues[1];
-    const float stdDevVal = data[i].dataValues[2];
-    const float gradVal = data[i].dataValues[3];
-
-    if(intensityVal > maxIntensity)
-      maxIntensity = intensityVal;
-    if(intensityVal < minIntensity)
-      minIntensity = intensityVal;
-
-    if(avgVal > maxAvg)
-      maxAvg = avgVal;
-    if(avgVal < minAvg)
-      minAvg = avgVal;
-
-    if(stdDevVal > maxStdDev)
-      maxStdDev = stdDevVal;
-    if(stdDevVal < minStdDev)
-      minStdDev = stdDevVal;
-
-    if(gradVal > maxGrad)
-      maxGrad = gradVal;
-    if(gradVal < minGrad)
-      minGrad = gradVal;
+    glBindBuffer(GL_ARRAY_BUFFER, _linePickingBuffer);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glColorPointer(3, GL_FLOAT, 0, 0);
   }
+  else
+  {
+    glColor3f(0,1,0);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, _lineVertexBuffer);
 
-  for(int i = 0; i < data.size(); i++)
+  if(_nVisibleLineIndices > 0)
   {
-    const float intensityVal= data[i].dataValues[0];
-    const float avgVal= data[i].dataValues[1];
-    const float stdDevVal = data[i].dataValues[2];
-    const float gradVal = data[i].dataValues[3];
-
-    //(värde-min)/(max-min)
-
-    float intNorm = -1+(intensityVal-minIntensity)*2/(maxIntensity-minIntensity);
-    float avgNorm = -1+(avgVal-minAvg)*2/(maxAvg-minAvg);
-    float stdDevNorm = -1+(stdDevVal-minStdDev)*2/(maxStdDev-minStdDev);
-    float gradNorm = -1+(gradVal-minGrad)*2/(maxGrad-minGrad);
-    if(intNorm > 1 || intNorm < -1)
-    {
-      LINFOC("int", intNorm);
-    }
-    if( intNorm > _handles.at(0)._position.y ||
-        intNorm < _handles.at(1)._position.y ||
-        avgNorm > _handles.at(2)._position.y ||
-        avgNorm < _handles.at(3)._position.y ||
-        stdDevNorm > _handles.at(4)._position.y ||
-        stdDevNorm < _handles.at(5)._position.y ||
-        gradNorm > _handles.at(6)._position.y ||
-        gradNorm < _handles.at(7)._position.y )
-    {
-      _brushingList.insert(data[i].voxelIndex);
-      continue;
-    }
-        
-    _brushingList.erase(data[i].voxelIndex);
-    glBegin(GL_LINES);
-    
-    if(picking)
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _visibleLineBuffer);
+    drawAxisPairs(_nVisibleLineIndices, nRows, nAxes);
+  }
+
+  if(picking)
+  {
+    glDisableClientState(GL_COLOR_ARRAY);
+  }
+  else if(_nLinkedLineIndices > 0)
+  {
+    glColor3f(1,0,0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _linkedLineBuffer);
+    drawAxisPairs(_nLinkedLineIndices, nRows, nAxes);
+  }
+
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glPopMatrix();
+}
+
+bool TNMParallelCoordinates::drawsDensity(const FeatureTable& data) const {
+    const int mode = _lineMode.getValue();
+    return mode == LineModeDensity || (mode == LineModeAutomatic && data.size() > DensityRowThreshold);
+}
+
+void TNMParallelCoordinates::lineModeChanged() {
+    _lineIndicesValid = false;
+}
+
+void TNMParallelCoordinates::buildDensity() {
+    const size_t nAxes = _lineMeasures.size();
+    const size_t nPairs = (nAxes > 0) ? nAxes - 1 : 0;
+    _density.assign(nPairs * NumDensityBins * NumDensityBins, 0);
+    _densityMeasures = _lineMeasures;
+    std::vector<size_t> pairs(nPairs);
+    for (size_t pair = 0; pair < nPairs; ++pair)
+        pairs[pair] = pair;
+    countDensity(pairs);
+}
+
+void TNMParallelCoordinates::countDensity(const std::vector<size_t>& pairs) {
+    if (pairs.empty())
+        return;
+    const size_t pairBins = NumDensityBins * NumDensityBins;
+    const std::vector<const float*> values = axisValues();
+    for (size_t i = 0; i < pairs.size(); ++i)
+        std::fill(_density.begin() + pairs[i] * pairBins, _density.begin() + (pairs[i] + 1) * pairBins, 0);
+
+	// Each thread counts a share of the rows on its own and adds its counts at the end
+    const long nWords = static_cast<long>(_visibleRows.size());
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
     {
-      int voxelIndex = i;
-      glColor3f( 0, (voxelIndex+1)/(data.size()*255.f), 0);
+        std::vector<unsigned int> counts(pairs.size() * pairBins, 0);
+#ifdef _OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for (long w = 0; w < nWords; ++w) {
+            for (uint64_t bits = _visibleRows[w]; bits != 0; bits &= bits - 1) {
+                const size_t row = w * 64 + lowestBit(bits);
+                for (size_t i = 0; i < pairs.size(); ++i) {
+                    const float left = values[pairs[i]][row];
+                    const float right = values[pairs[i] + 1][row];
+					// Values that are not numbers have no place on the axes
+                    if (left != left || right != right)
+                        continue;
+                    ++counts[i * pairBins + densityBin(left) * NumDensityBins + densityBin(right)];
+                }
+            }
+        }
+#ifdef _OPENMP
+        #pragma omp critical
+#endif
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            for (size_t b = 0; b < pairBins; ++b)
+                _density[pairs[i] * pairBins + b] += counts[i * pairBins + b];
+        }
     }
-    else
-    {
-      if(_linkingList.find(i) != _linkingList.end())
-      {
-	glColor3f(1,0,0);
-      }
-      else
-      {
-	glColor3f(0,1,0);
-      }
-      
+}
+
+void TNMParallelCoordinates::updateDensity(const std::vector<const float*>& values, size_t row, bool add) {
+    for (size_t pair = 0; pair + 1 < values.size(); ++pair) {
+        const float left = values[pair][row];
+        const float right = values[pair + 1][row];
+        if (left != left || right != right)
+            continue;
+        unsigned int& count = _density[pair * NumDensityBins * NumDensityBins + densityBin(left) * NumDensityBins
+                                       + densityBin(right)];
+        if (add)
+            ++count;
+        else
+            --count;
     }
-    
-    glVertex2f(-1, intNorm);
-    glVertex2f(-0.33, avgNorm);
+}
 
-    glVertex2f(-0.33, avgNorm);
-    glVertex2f(0.33, stdDevNorm);
+void TNMParallelCoordinates::renderDensity() {
+    if (_lineTable == 0 || _density.empty())
+        return;
 
-    glVertex2f(0.33, stdDevNorm);
-    glVertex2f(1, gradNorm);
-    glEnd();
+	// Each pair of bins with rows between them becomes a band from the left to the right bin.
+	// Fuller bands are drawn later, so that they end up on top
+    std::vector<std::pair<unsigned int, size_t> > bands;
+    unsigned int maximum = 0;
+    for (size_t i = 0; i < _density.size(); ++i) {
+        if (_density[i] == 0)
+            continue;
+        bands.push_back(std::make_pair(_density[i], i));
+        maximum = std::max(maximum, _density[i]);
+    }
+    std::sort(bands.begin(), bands.end());
 
-  }
+	// The counts span several orders of magnitude, so the color follows their logarithm: from
+	// dark green over green to yellow
+    const size_t nAxes = _lineMeasures.size();
+    const float scale = 1.f / std::log(1.f + maximum);
+    const float binHeight = 2.f / NumDensityBins;
+    glBegin(GL_QUADS);
+    for (size_t i = 0; i < bands.size(); ++i) {
+        const float t = std::log(1.f + bands[i].first) * scale;
+        glColor3f(std::max(0.f, 2.f * t - 1.f), 0.2f + 0.8f * std::min(1.f, 2.f * t), 0.f);
 
-  //0, intensity
-  //1, avg
-  //2, stddev
-  //3, gradient mag
+        const size_t pair = bands[i].second / (NumDensityBins * NumDensityBins);
+        const size_t left = (bands[i].second / NumDensityBins) % NumDensityBins;
+        const size_t right = bands[i].second % NumDensityBins;
+        const float leftX = axisPosition(pair, nAxes);
+        const float rightX = axisPosition(pair + 1, nAxes);
+        const float leftY = -1.f + left * binHeight;
+        const float rightY = -1.f + right * binHeight;
+        glVertex2f(leftX, leftY);
+        glVertex2f(rightX, rightY);
+        glVertex2f(rightX, rightY + binHeight);
+        glVertex2f(leftX, leftY + binHeight);
+    }
+    glEnd();
+}
 
+void TNMParallelCoordinates::renderHistograms() {
+    if (_lineTable == 0)
+        return;
 
+	// The bars of each axis extend to its right, with the fullest bin as wide as a tenth of the plot
+    const size_t nAxes = _lineMeasures.size();
+    glColor3f(0.3f, 0.3f, 0.3f);
+    glBegin(GL_QUADS);
+    for (size_t axis = 0; axis < nAxes; ++axis) {
+        const std::vector<unsigned int>& histogram = measureStatistics(_lineMeasures[axis], true).histogram;
+        const unsigned int maximum = *std::max_element(histogram.begin(), histogram.end());
+        if (maximum == 0)
+            continue;
+        const float x = axisPosition(axis, nAxes);
+        for (int bin = 0; bin < NumHistogramBins; ++bin) {
+            const float width = 0.1f * histogram[bin] / maximum;
+            const float bottom = -1.f + 2.f * bin / NumHistogramBins;
+            const float top = -1.f + 2.f * (bin + 1) / NumHistogramBins;
+            glVertex2f(x, bottom);
+            glVertex2f(x + width, bottom);
+            glVertex2f(x + width, top);
+            glVertex2f(x, top);
+        }
+    }
+    glEnd();
 }
 
 void TNMParallelCoordinates::renderLinesPicking() {
 	// Use the same code to render lines (without duplicating it), but think of a way to encode the
 	// voxel identifier into the color. The red color channel is already occupied, so you have 3
 	// channels with 32-bit each at your disposal (green, blue, alpha)
+	// The ids are whole numbers far beyond 1 that have to arrive unchanged, so the colors are neither
+	// clamped to [0,1] nor interpolated along the lines
+	glClampColor(GL_CLAMP_VERTEX_COLOR, GL_FALSE);
+	glShadeModel(GL_FLAT);
 	renderLines(true);
+	glShadeModel(GL_SMOOTH);
+	glClampColor(GL_CLAMP_VERTEX_COLOR, GL_TRUE);
+
+}
 
+tgt::vec4 TNMParallelCoordinates::readPickingTexel(const tgt::ivec2& position) {
+    tgt::vec4 texel(0.f, 0.f, 0.f, 0.f);
+    const tgt::ivec2 size = _privatePort.getSize();
+    if (position.x < 0 || position.y < 0 || position.x >= size.x || position.y >= size.y)
+        return texel;
+
+	// Only this texel is transferred instead of the whole texture. The read is synchronous and
+	// waits until the picking pass is finished, but a click needs its answer right away, so the
+	// wait couldn't be moved to a later frame anyway. Hovering avoids it by picking on the CPU
+    _privatePort.activateTarget();
+    glReadPixels(position.x, position.y, 1, 1, GL_RGBA, GL_FLOAT, texel.elem);
+    _privatePort.deactivateTarget();
+    return texel;
+}
+
+void TNMParallelCoordinates::renderHoveredLine() {
+    if (_lineTable == 0 || _hoveredRow < 0 || static_cast<size_t>(_hoveredRow) >= _lineTable->size())
+        return;
+    const size_t nAxes = _lineMeasures.size();
+    glColor3f(1.f, 1.f, 0.f);
+    glBegin(GL_LINE_STRIP);
+    for (size_t axis = 0; axis < nAxes; ++axis)
+        glVertex2f(axisPosition(axis, nAxes), _measureValues[_lineMeasures[axis]][_hoveredRow]);
+    glEnd();
 }
 
 void TNMParallelCoordinates::renderHandles() {
-    for (size_t i = 0; i < _handles.size(); ++i) {
-        const AxisHandle& handle = _handles[i];
-        handle.render();
+	// Only the measures with an axis show their handles
+    for (size_t axis = 0; axis < _lineMeasures.size(); ++axis) {
+        _handles.at(2 * _lineMeasures[axis]).render();
+        _handles.at(2 * _lineMeasures[axis] + 1).render();
     }
 }
 
 void TNMParallelCoordinates::renderHandlesPicking() {
-    for (size_t i = 0; i < _handles.size(); ++i) {
-        const AxisHandle& handle = _handles[i];
-        handle.renderPicking();
+    for (size_t axis = 0; axis < _lineMeasures.size(); ++axis) {
+        _handles.at(2 * _lineMeasures[axis]).renderPicking();
+        _handles.at(2 * _lineMeasures[axis] + 1).renderPicking();
     }
 }
 
@@ -5,6 +5,34 @@
 
 namespace voreen {
 
+namespace {
+	// Collects the coordinates of all points, two per point, together with the smallest and
+	// largest coordinate along both axes
+	template <typename T>
+	void collectPositions(const FeatureTable& data, const T* firstColumn, const T* secondColumn,
+	                      std::vector<T>& positionData, tgt::vec2& minimum, tgt::vec2& maximum)
+	{
+		positionData.reserve(data.size() * 2);
+		minimum = tgt::vec2(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+		maximum = tgt::vec2(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+		// The columns are those of data.storage(), which for views contains more rows than data
+		for (FeatureRowIterator it(data); !it.atEnd(); it.next()) {
+			const size_t i = it.storageRow();
+			positionData.push_back(firstColumn[i]);
+			positionData.push_back(secondColumn[i]);
+			const float firstCoordinate = static_cast<float>(firstColumn[i]);
+			const float secondCoordinate = static_cast<float>(secondColumn[i]);
+			minimum.x = std::min(minimum.x, firstCoordinate);
+			maximum.x = std::max(maximum.x, firstCoordinate);
+			minimum.y = std::min(minimum.y, secondCoordinate);
+			maximum.y = std::max(maximum.y, secondCoordinate);
+		}
+	}
+
+	// Changed rows that are closer than this many bytes of the state buffer are uploaded together
+	const size_t StateUploadGap = 4096;
+}
+
 TNMScatterPlot::TNMScatterPlot()
     : RenderProcessor()
     , _inport(Port::INPORT, "in.data")
@@ -14,7 +42,14 @@ TNMScatterPlot::TNMScatterPlot()
     , _secondAxis("secondAxis", "Second Axis")
 	, _brushingIndices("brushingIndices", "Brushing Indices")
 	, _linkingIndices("linkingIndices", "Linking Indices")
+    , _frameBudget("frameBudget", "Frame Time Budget (ms)", 33.f, 1.f, 1000.f)
+    , _interacting("interacting", "Interacting", false)
+    , _positionBuffer(0)
+    , _stateBuffer(0)
+    , _pointTable(0)
+    , _pointsQuantized(false)
 {
+    _pointAxes[0] = _pointAxes[1] = -1;
     addPort(_inport);
     addPort(_outport);
 
@@ -22,17 +57,25 @@ TNMScatterPlot::TNMScatterPlot()
     addProperty(_secondAxis);
 	addProperty(_brushingIndices);
 	addProperty(_linkingIndices);
+    addProperty(_frameBudget);
+	// Link this to the property of the same name in the parallel coordinates
+    addProperty(_interacting);
+
+	// Assign the option value "Intensity" to the value 0 etc, one option for each measure in the registry
+    FeatureRegistry::instance().addOptions(_firstAxis);
+    FeatureRegistry::instance().addOptions(_secondAxis);
 
-	// Assign the option value "Intensity" to the value 0 etc
-    _firstAxis.addOption("0", "Intensity", 0);
-    _firstAxis.addOption("1", "Average", 1);
-    _firstAxis.addOption("2", "Standard Deviation", 2);
-    _firstAxis.addOption("3", "Gradient Magnitude", 3);
+    _firstAxis.onChange(CallMemberAction<TNMScatterPlot>(this, &TNMScatterPlot::axisChanged));
+    _secondAxis.onChange(CallMemberAction<TNMScatterPlot>(this, &TNMScatterPlot::axisChanged));
+}
+
+FeatureSet TNMScatterPlot::requestedFeatures() const {
+    return featureBit(_firstAxis.getValue()) | featureBit(_secondAxis.getValue());
+}
 
-    _secondAxis.addOption("0", "Intensity", 0);
-    _secondAxis.addOption("1", "Average", 1);
-    _secondAxis.addOption("2", "Standard Deviation", 2);
-    _secondAxis.addOption("3", "Gradient Magnitude", 3);
+void TNMScatterPlot::axisChanged() {
+    if (_inport.hasData() && (_inport.getData()->features() & requestedFeatures()) != requestedFeatures())
+        invalidateFeatureProducers(_inport);
 }
 
 void TNMScatterPlot::initialize() throw (tgt::Exception) {
@@ -42,122 +85,214 @@ void TNMScatterPlot::initialize() throw (tgt::Exception) {
 
 void TNMScatterPlot::deinitialize() throw (tgt::Exception) {
 	ShdrMgr.dispose(_shader);
+    if (_positionBuffer != 0) {
+        glDeleteBuffers(1, &_positionBuffer);
+        glDeleteBuffers(1, &_stateBuffer);
+        _positionBuffer = _stateBuffer = 0;
+    }
+    _pointTable = 0;
 }
 
 void TNMScatterPlot::process() {
     if (!_inport.hasData())
         return;
+	// Tables that were spilled to disk have to be reduced by a TNMDataReduction first
+    if (!_inport.getData()->isResident()) {
+        LWARNINGC("TNMScatterPlot", "The data was spilled to disk and has to be reduced before plotting");
+        return;
+    }
+	// If a measure is missing, the table is still being computed with the new axes
+    if ((_inport.getData()->features() & requestedFeatures()) != requestedFeatures())
+        return;
 
 	// Activate the outport as the rendering target
     _outport.activateTarget();
 	// Clear the buffer
     _outport.clearTarget();
 
-	// Access the provided data. We have already checked before that it exists, so dereferencing it here is safe
-    const Data& data = *(_inport.getData());
-
-	// The set contains all indices of voxels that should be ignored
-	const std::set<unsigned int>& brushingIndices = _brushingIndices.get();
-	// The set contains all indices of voxels that should be visually selected
-	const std::set<unsigned int>& selectionIndices = _linkingIndices.get();
-
-	// The number of points is equal to the number in the original dataset minus the number we are ignoring
-	const size_t dataSize = data.size() - brushingIndices.size();
-	// There are 2 coordinate components for each point
-	const size_t nCoordinateComponents = dataSize * 2;
-
-	// The vector containing the position data
-	std::vector<float> positionData;
-	// Make room in the vector
-	positionData.resize(nCoordinateComponents); 
-
-	// The vector containing boolean flags saying for each position if it is selected
-	// OpenGL doesn't support boolean values for the vertex buffer, so we take the next best thing instead
-	std::vector<unsigned char> selectionData(dataSize, 0);
-	
-	// In order to map the value ranges to [-1,1] we need to find the mininum and maximum values
-	float minimumFirstCoordinate = std::numeric_limits<float>::max();
-	float maximumFirstCoordinate = -std::numeric_limits<float>::max();
-	float minimumSecondCoordinate = std::numeric_limits<float>::max();
-	float maximumSecondCoordinate = -std::numeric_limits<float>::max();
-	// i: index into the data
-	// j: index into the coordinates
-	for (size_t i = 0, j = 0; i < data.size(); ++i) {
-		//// See if the index i is in the vector for brushing
-		if (brushingIndices.find(data[i].voxelIndex) != brushingIndices.end())
-			// If it is, we ignore it
-			continue;
-		else {
-			// otherwise add it to the position data
-			// _firstAxis.getValue() and _secondAxis.getValue() returns the integer value specified above
-			// to determine which selection was chosen in the GUI
-			const float firstCoordinate = data[i].dataValues[_firstAxis.getValue()];
-			const float secondCoordinate = data[i].dataValues[_secondAxis.getValue()];
-			positionData[j] = firstCoordinate;
-			positionData[j+1] = secondCoordinate;
-			j += 2;
-
-			minimumFirstCoordinate = std::min(minimumFirstCoordinate, firstCoordinate);
-			maximumFirstCoordinate = std::max(maximumFirstCoordinate, firstCoordinate);
-			minimumSecondCoordinate = std::min(minimumSecondCoordinate, secondCoordinate);
-			maximumSecondCoordinate = std::max(maximumSecondCoordinate, secondCoordinate);
-		}
-	}
-
-	// In a second step, we need to normalize the found data. By now we have looked at each value and found the
-	// min/max values
-	// Normalizing the data values to the range [-1,1]
-	for (size_t i = 0; i < nCoordinateComponents; i+=2) {
-		// First normalize to [0,1]
-		positionData[i] = (positionData[i] - minimumFirstCoordinate) / (maximumFirstCoordinate - minimumFirstCoordinate);
-		positionData[i+1] = (positionData[i+1] - minimumSecondCoordinate) / (maximumSecondCoordinate - minimumSecondCoordinate);
-		
-		// Then shift the normalized values to [-1,1]
-		positionData[i] = (positionData[i] - 0.5f) * 2.f;
-		positionData[i+1] = (positionData[i+1] - 0.5f) * 2.f;
-	}
+	// Access the provided data. We have already checked before that it exists, so dereferencing it here is safe.
+	// While the user interacts with the views, a coarser level of the table is drawn if the full
+	// table doesn't fit into the frame time budget
+    _levelOfDetail.beginFrame();
+    const FeatureTable& table = *(_inport.getData());
+    const FeatureTable& data = _levelOfDetail.select(table, _frameBudget.get(), _interacting.get());
+	// _firstAxis.getValue() and _secondAxis.getValue() returns the integer value specified above
+	// to determine which selection was chosen in the GUI. Only these two columns are read
+	const int firstAxis = _firstAxis.getValue();
+	const int secondAxis = _secondAxis.getValue();
 
-	// Set the selection array for all selected indices
-	for (std::set<unsigned int>::const_iterator i = selectionIndices.begin();
-		i != selectionIndices.end();
-		++i) 
-	{
-		const unsigned int thisIndex = *i;
-		LINFOC("scatterlinking", "adding: " << thisIndex);
-		selectionData[thisIndex] = 1;
-	}
+	// The positions are only uploaded for a new table or new axes. Otherwise the points keep
+	// their place in the buffers and only the states of those that were brushed or linked change
+	if (&data != _pointTable || _inport.hasChanged() || firstAxis != _pointAxes[0] || secondAxis != _pointAxes[1])
+		updatePoints(data, table, firstAxis, secondAxis);
+	else
+		updatePointStates();
+	const size_t dataSize = _pointStates.size();
 
 	// We want to be able to set the point size from the vertex shader
 	glEnable(GL_PROGRAM_POINT_SIZE);
 
-	// Activate, create, and fill the vbo containing the position data
-	GLuint vbo;
+	// Activate the vbo containing the position data
 	glEnableVertexAttribArray(0);
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, positionData.size() * sizeof(float), &(positionData[0]), GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, _positionBuffer);
+	if (_pointsQuantized) {
+		// The quantized values are normalized to [0,1] by OpenGL
+		glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_TRUE, 0, 0);
+	}
+	else
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
 
-	// Activate, create, and fill the vbo containing the selection data
-	GLuint selectionVbo;
+	// Activate the vbo containing the state of each point
 	glEnableVertexAttribArray(1);
-	glGenBuffers(1, &selectionVbo);
-	glBindBuffer(GL_ARRAY_BUFFER, selectionVbo);
-	glBufferData(GL_ARRAY_BUFFER, selectionData.size() * sizeof(unsigned char), &(selectionData[0]), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, _stateBuffer);
 	glVertexAttribIPointer(1, 1, GL_UNSIGNED_BYTE, 0, 0);
 
 	// Activate the shader required for rendering
 	_shader->activate();
+	_shader->setUniform("positionScale_", _positionScale);
+	_shader->setUniform("positionOffset_", _positionOffset);
 
-	// Draw the points
+	// Draw the points; the brushed ones are dropped by the vertex shader
 	glDrawArrays(GL_POINTS, 0, dataSize);
 
 	// And be a good citizen and clean up
 	_shader->deactivate();
-	glDeleteBuffers(1, &vbo);
+	glDisableVertexAttribArray(1);
+	glDisableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glDisable(GL_PROGRAM_POINT_SIZE);
     _outport.deactivateTarget();
+    _levelOfDetail.endFrame(dataSize);
+}
+
+void TNMScatterPlot::updatePoints(const FeatureTable& data, const FeatureTable& table, int firstAxis, int secondAxis) {
+	// The position data is uploaded in the format the table stores it in; quantized tables are
+	// uploaded as they are, which halves the size of the vertex buffer. Views are read directly
+	// from the columns of the table they refer to
+	const FeatureTable& storage = data.storage();
+	std::vector<float> positionData;
+	std::vector<uint16_t> quantizedPositionData;
+	tgt::vec2 minimum;
+	tgt::vec2 maximum;
+	if (data.isQuantized()) {
+		collectPositions(data, storage.quantizedColumn(firstAxis), storage.quantizedColumn(secondAxis),
+		                 quantizedPositionData, minimum, maximum);
+	}
+	else {
+		collectPositions(data, storage.column(firstAxis), storage.column(secondAxis), positionData, minimum, maximum);
+	}
+
+	// With a pyramid, the axes span the range of the whole table, so that they don't move when
+	// the level changes. The range is converted to the units the values are uploaded in
+	if (table.pyramid()) {
+		const int axes[2] = { firstAxis, secondAxis };
+		for (int i = 0; i < 2; ++i) {
+			const tgt::vec2 range = table.pyramid()->range(axes[i]);
+			const FeatureTable::Quantization& quantization = data.quantization(axes[i]);
+			minimum[i] = data.isQuantized() ? (range.x - quantization.offset) / quantization.scale : range.x;
+			maximum[i] = data.isQuantized() ? (range.y - quantization.offset) / quantization.scale : range.y;
+		}
+	}
+
+	// The vertex shader maps the values to [-1,1] instead of us doing it here. Quantized values
+	// reach the shader normalized to [0,1], so their range has to be scaled the same way
+	const float unit = data.isQuantized() ? 1.f / FeatureTable::Quantization::MaxValue : 1.f;
+	_positionScale = tgt::vec2(0.f, 0.f);
+	_positionOffset = tgt::vec2(0.f, 0.f);
+	for (int i = 0; i < 2; ++i) {
+		if (maximum[i] > minimum[i]) {
+			_positionScale[i] = 2.f / ((maximum[i] - minimum[i]) * unit);
+			_positionOffset[i] = -1.f - 2.f * minimum[i] / (maximum[i] - minimum[i]);
+		}
+	}
+
+	// The brushing and the linking name voxels, so the rows of the voxels have to be found
+	_voxelRows.build(data);
+
+	// The set contains all indices of voxels that should be ignored
+	_brushingSnapshot = _brushingIndices.get();
+	// The set contains all indices of voxels that should be visually selected
+	_linkingSnapshot = _linkingIndices.get();
+	_pointStates.assign(data.size(), 0);
+	for (FeatureRowIterator it(data); !it.atEnd(); it.next()) {
+		// See if the voxel of the row is in the set for brushing. If it is, we ignore it
+		if (_brushingSnapshot.contains(storage.voxelIndex(it.storageRow())))
+			_pointStates[it.row()] |= PointBrushed;
+	}
+	// Coarser levels of the table don't have a row for every linked voxel
+	for (IndexSet::const_iterator i = _linkingSnapshot.begin(); i != _linkingSnapshot.end(); ++i) {
+		const long row = _voxelRows.row(*i);
+		if (row >= 0)
+			_pointStates[row] |= PointLinked;
+	}
+
+	if (_positionBuffer == 0) {
+		glGenBuffers(1, &_positionBuffer);
+		glGenBuffers(1, &_stateBuffer);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, _positionBuffer);
+	if (data.isQuantized()) {
+		glBufferData(GL_ARRAY_BUFFER, quantizedPositionData.size() * sizeof(uint16_t),
+		             quantizedPositionData.empty() ? 0 : &quantizedPositionData[0], GL_STATIC_DRAW);
+	}
+	else
+		glBufferData(GL_ARRAY_BUFFER, positionData.size() * sizeof(float), positionData.empty() ? 0 : &positionData[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, _stateBuffer);
+	glBufferData(GL_ARRAY_BUFFER, _pointStates.size(), _pointStates.empty() ? 0 : &_pointStates[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	_pointTable = &data;
+	_pointAxes[0] = firstAxis;
+	_pointAxes[1] = secondAxis;
+	_pointsQuantized = data.isQuantized();
+}
+
+void TNMScatterPlot::updatePointStates() {
+	// The sets on the properties share the chunks that didn't change with the snapshots, so
+	// finding the changes only looks at the chunks that did
+	IndexSet brushed;
+	IndexSet unbrushed;
+	_brushingIndices.get().changesSince(_brushingSnapshot, brushed, unbrushed);
+	IndexSet linked;
+	IndexSet unlinked;
+	_linkingIndices.get().changesSince(_linkingSnapshot, linked, unlinked);
+	if (brushed.empty() && unbrushed.empty() && linked.empty() && unlinked.empty())
+		return;
+
+	std::vector<size_t> changedRows;
+	changePointStates(brushed, PointBrushed, true, changedRows);
+	changePointStates(unbrushed, PointBrushed, false, changedRows);
+	changePointStates(linked, PointLinked, true, changedRows);
+	changePointStates(unlinked, PointLinked, false, changedRows);
+	_brushingSnapshot = _brushingIndices.get();
+	_linkingSnapshot = _linkingIndices.get();
+
+	// Only the ranges of the state buffer around the changed rows are uploaded again
+	std::sort(changedRows.begin(), changedRows.end());
+	glBindBuffer(GL_ARRAY_BUFFER, _stateBuffer);
+	for (size_t i = 0; i < changedRows.size();) {
+		const size_t first = changedRows[i];
+		size_t last = first;
+		for (++i; i < changedRows.size() && changedRows[i] <= last + StateUploadGap; ++i)
+			last = changedRows[i];
+		glBufferSubData(GL_ARRAY_BUFFER, first, last - first + 1, &_pointStates[first]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+void TNMScatterPlot::changePointStates(const IndexSet& voxels, unsigned char flag, bool set,
+                                       std::vector<size_t>& changedRows)
+{
+	for (IndexSet::const_iterator i = voxels.begin(); i != voxels.end(); ++i) {
+		const long row = _voxelRows.row(*i);
+		if (row < 0 || static_cast<size_t>(row) >= _pointStates.size())
+			continue;
+		if (set)
+			_pointStates[row] |= flag;
+		else
+			_pointStates[row] &= ~flag;
+		changedRows.push_back(static_cast<size_t>(row));
+	}
+}
 
 } // namespace
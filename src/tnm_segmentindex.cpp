@@ -0,0 +1,138 @@
+#include "modules/tnm093/include/tnm_segmentindex.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace voreen {
+
+const int LineSegmentIndex::NumBins;
+
+LineSegmentIndex::LineSegmentIndex() {
+    clear();
+}
+
+void LineSegmentIndex::clear() {
+    _nRows = 0;
+    std::vector<Gap>().swap(_gaps);
+}
+
+void LineSegmentIndex::Gap::swap(Gap& other) {
+    std::swap(left, other.left);
+    std::swap(right, other.right);
+    offsets.swap(other.offsets);
+    rows.swap(other.rows);
+}
+
+int LineSegmentIndex::bin(float value) const {
+    const int b = static_cast<int>((value + 1.f) * 0.5f * NumBins);
+    return std::min(NumBins - 1, std::max(0, b));
+}
+
+void LineSegmentIndex::build(const std::vector<const float*>& columns, size_t nRows) {
+    clear();
+    update(columns, nRows);
+}
+
+void LineSegmentIndex::update(const std::vector<const float*>& columns, size_t nRows) {
+    if (nRows != _nRows)
+        clear();
+    _nRows = nRows;
+
+	// The gaps between the same two columns as before are taken over, all others are new
+    const size_t nGaps = (columns.size() > 1) ? columns.size() - 1 : 0;
+    std::vector<Gap> gaps(nGaps);
+    std::vector<long> newGaps;
+    for (size_t g = 0; g < nGaps; ++g) {
+        gaps[g].left = columns[g];
+        gaps[g].right = columns[g + 1];
+        size_t old = 0;
+        while (old < _gaps.size() && (_gaps[old].left != columns[g] || _gaps[old].right != columns[g + 1]))
+            ++old;
+        if (old < _gaps.size())
+            gaps[g].swap(_gaps[old]);
+        else
+            newGaps.push_back(static_cast<long>(g));
+    }
+    _gaps.swap(gaps);
+
+	// The gaps are independent of each other, so they are sorted concurrently
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (long i = 0; i < static_cast<long>(newGaps.size()); ++i)
+        buildGap(_gaps[newGaps[i]]);
+}
+
+void LineSegmentIndex::buildGap(Gap& gap) const {
+	// A counting sort of the rows by their bucket
+    const size_t gapBuckets = NumBins * NumBins;
+    std::vector<size_t> counts(gapBuckets, 0);
+    for (size_t row = 0; row < _nRows; ++row) {
+        const float left = gap.left[row];
+        const float right = gap.right[row];
+		// Values that are not numbers are not drawn, so their rows can't be picked
+        if (left == left && right == right)
+            ++counts[bin(left) * NumBins + bin(right)];
+    }
+    gap.offsets.resize(gapBuckets + 1);
+    size_t start = 0;
+    for (size_t b = 0; b < gapBuckets; ++b) {
+        gap.offsets[b] = start;
+        start += counts[b];
+    }
+    gap.offsets[gapBuckets] = start;
+
+    gap.rows.resize(start);
+    std::vector<size_t> next(gap.offsets.begin(), gap.offsets.end() - 1);
+    for (size_t row = 0; row < _nRows; ++row) {
+        const float left = gap.left[row];
+        const float right = gap.right[row];
+        if (left == left && right == right)
+            gap.rows[next[bin(left) * NumBins + bin(right)]++] = static_cast<uint32_t>(row);
+    }
+}
+
+long LineSegmentIndex::findNearest(const tgt::vec2& point, float maxDistance, const std::vector<uint64_t>& visible) const {
+    if (_gaps.empty() || _nRows == 0)
+        return -1;
+
+	// The gap the point lies in, and how far it is along the gap from the left axis
+    const float position = (point.x + 1.f) * 0.5f * _gaps.size();
+    if (!(position >= 0.f) || position > _gaps.size())
+        return -1;
+    const size_t g = std::min(static_cast<size_t>(position), _gaps.size() - 1);
+    const Gap& gap = _gaps[g];
+    const float t = position - g;
+
+    long nearest = -1;
+    float nearestDistance = maxDistance;
+    const float binHeight = 2.f / NumBins;
+	// The rounding in bin() and in the interpolation can put a line a few ulps outside of the
+	// heights of its bucket, so the buckets are widened by a little more than that
+    const float slack = 1e-5f;
+    for (int left = 0; left < NumBins; ++left) {
+        const float leftLow = -1.f + left * binHeight;
+        for (int right = 0; right < NumBins; ++right) {
+			// The segments of the bucket pass between these two heights at the point
+            const float rightLow = -1.f + right * binHeight;
+            const float low = (1.f - t) * leftLow + t * rightLow;
+            if (point.y < low - nearestDistance - slack || point.y > low + binHeight + nearestDistance + slack)
+                continue;
+
+            const size_t bucket = left * NumBins + right;
+            for (size_t i = gap.offsets[bucket]; i < gap.offsets[bucket + 1]; ++i) {
+                const uint32_t row = gap.rows[i];
+                if (!visible.empty() && !(visible[row / 64] & (uint64_t(1) << (row % 64))))
+                    continue;
+                const float distance = std::abs((1.f - t) * gap.left[row] + t * gap.right[row] - point.y);
+                if (distance < nearestDistance || (distance == nearestDistance && nearest == -1)) {
+                    nearest = static_cast<long>(row);
+                    nearestDistance = distance;
+                }
+            }
+        }
+    }
+    return nearest;
+}
+
+} // namespace
@@ -1,15 +1,589 @@
 #include "modules/tnm093/include/tnm_volumeinformation.h"
+#include "modules/tnm093/include/tnm_featurefile.h"
+#include "modules/tnm093/include/tnm_featurekernels.h"
+#include "modules/tnm093/include/tnm_featureregistry.h"
 #include "voreen/core/datastructures/volume/volumeatomic.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace voreen {
 
 	const std::string loggerCat_ = "TNMVolumeInformation";
 
 namespace {
-	// This ordering function allows us to sort the Data vector by the voxelIndex
-	// The extraction *should* produce a sorted list, but you never know
-	bool sortByIndex(const VoxelDataItem& lhs, const VoxelDataItem& rhs) {
-		return lhs.voxelIndex < rhs.voxelIndex;
+	// The number of slabs that are handed out per worker thread
+	const long SlabsPerThread = 4;
+
+	// The version of the measures that are computed here. Increase it whenever the extraction
+	// changes its results, so that the tables cached by an older version are not used anymore
+	const uint64_t ExtractorVersion = 2;
+
+	// The volume is hashed in chunks of this many bytes, which can be hashed in parallel
+	const size_t HashChunkSize = 1 << 20;
+
+	const uint64_t FnvOffsetBasis = 14695981039346656037ULL;
+	const uint64_t FnvPrime = 1099511628211ULL;
+
+	// Use all available cores by default
+	int defaultNumThreads() {
+#ifdef _OPENMP
+		return omp_get_num_procs();
+#else
+		return 1;
+#endif
+	}
+
+	// The parameters of an extraction that are the same for all slabs
+	struct ExtractionSettings {
+		int radius; // The radius of the neighbourhood
+		int requirements; // The FeatureDescriptor::Requirement flags of the requested measures
+		float binScale; // The mapping of intensities to the bins of the local histograms
+		float binOffset;
+	};
+
+	// The (2*radius+1)^3 neighbourhood around the voxels of one z-plane. It keeps a ring buffer
+	// of the 2*radius+1 planes around the current plane together with their window sums and
+	// updates the running sums along z whenever it moves on by one plane. The window sums are
+	// only computed if one of the requested measures needs them
+	template <typename T>
+	class NeighbourhoodWindow {
+	public:
+		// For 8 and 16 bit integers all sums are integers below 2^53, which a double represents
+		// exactly. Only then adding the entering and subtracting the leaving plane gives the same
+		// result as summing up the planes, independent of where a slab started
+		static const bool HasExactSums = std::numeric_limits<T>::is_integer && sizeof(T) <= 2;
+
+		NeighbourhoodWindow(const T* voxels, const tgt::svec3& dimensions, const ExtractionSettings& settings)
+			: _voxels(voxels)
+			, _dimensions(dimensions)
+			, _radius(settings.radius)
+			, _windowSize(2 * settings.radius + 1)
+			, _planeSize(dimensions.x * dimensions.y)
+			, _needsSums((settings.requirements & FeatureDescriptor::RequiresWindowSums) != 0)
+			, _binScale(settings.binScale)
+			, _binOffset(settings.binOffset)
+			, _currentPlane(-1)
+			, _intensities(_windowSize * _planeSize)
+			, _planeRows(_windowSize)
+			, _planeSums(_needsSums ? _windowSize * _planeSize : 0)
+			, _planeSumsSquared(_needsSums ? _windowSize * _planeSize : 0)
+			, _sums(_needsSums ? _planeSize : 0)
+			, _sumsSquared(_needsSums ? _planeSize : 0)
+			, _rowSums(_needsSums ? _planeSize : 0)
+			, _rowSumsSquared(_needsSums ? _planeSize : 0)
+		{}
+
+		// Moves the window to the plane z. Moving on to the next plane only loads the plane that
+		// enters the window, any other move fills the whole ring buffer
+		void moveTo(size_t z) {
+			const long target = static_cast<long>(z);
+			const bool movesOn = (_currentPlane != -1 && target == _currentPlane + 1);
+			if (!_needsSums) {
+				if (movesOn)
+					loadPlane(z + _radius);
+				else {
+					for (size_t p = z - _radius; p <= z + _radius; ++p)
+						loadPlane(p);
+				}
+			}
+			else if (movesOn && HasExactSums) {
+				const size_t leaving = z - _radius - 1;
+				const size_t entering = z + _radius;
+				for (size_t i = 0; i < _planeSize; ++i) {
+					_sums[i] -= planeSums(leaving)[i];
+					_sumsSquared[i] -= planeSumsSquared(leaving)[i];
+				}
+				loadPlane(entering);
+				for (size_t i = 0; i < _planeSize; ++i) {
+					_sums[i] += planeSums(entering)[i];
+					_sumsSquared[i] += planeSumsSquared(entering)[i];
+				}
+			}
+			else {
+				if (movesOn)
+					loadPlane(z + _radius);
+				else {
+					for (size_t p = z - _radius; p <= z + _radius; ++p)
+						loadPlane(p);
+				}
+				// Sum up the planes in a fixed order, so that the rounding is always the same
+				std::fill(_sums.begin(), _sums.end(), 0.0);
+				std::fill(_sumsSquared.begin(), _sumsSquared.end(), 0.0);
+				for (size_t p = z - _radius; p <= z + _radius; ++p) {
+					for (size_t i = 0; i < _planeSize; ++i) {
+						_sums[i] += planeSums(p)[i];
+						_sumsSquared[i] += planeSumsSquared(p)[i];
+					}
+				}
+			}
+			_currentPlane = target;
+		}
+
+		// Returns the kernel input for the row y of the current plane. It stays valid until the
+		// next call of row or moveTo
+		FeatureRowInput row(size_t y) {
+			const size_t z = static_cast<size_t>(_currentPlane);
+			const size_t offset = y * _dimensions.x;
+			for (size_t p = 0; p < _windowSize; ++p)
+				_planeRows[p] = intensities(z - _radius + p) + offset;
+
+			FeatureRowInput input;
+			input.center = intensities(z) + offset;
+			input.previousY = input.center - _dimensions.x;
+			input.nextY = input.center + _dimensions.x;
+			input.previousZ = intensities(z - 1) + offset;
+			input.nextZ = intensities(z + 1) + offset;
+			input.planes = &_planeRows[0];
+			input.rowStride = _dimensions.x;
+			input.radius = static_cast<int>(_radius);
+			input.sum = _needsSums ? &_sums[offset] : 0;
+			input.sumSquared = _needsSums ? &_sumsSquared[offset] : 0;
+			input.inverseCount = 1.0 / (_windowSize * _windowSize * _windowSize);
+			input.binScale = _binScale;
+			input.binOffset = _binOffset;
+			return input;
+		}
+
+	private:
+		size_t slot(size_t z) const { return (z % _windowSize) * _planeSize; }
+		const float* intensities(size_t z) const { return &_intensities[slot(z)]; }
+		const double* planeSums(size_t z) const { return &_planeSums[slot(z)]; }
+		const double* planeSumsSquared(size_t z) const { return &_planeSumsSquared[slot(z)]; }
+
+		// Converts the plane z to float and computes its two-dimensional window sums
+		void loadPlane(size_t z) {
+			float* target = &_intensities[slot(z)];
+			convertToFloat(_voxels + z * _planeSize, target, _planeSize);
+			if (_needsSums) {
+				computeWindowSums(target, _dimensions.x, _dimensions.y, _radius,
+					&_planeSums[slot(z)], &_planeSumsSquared[slot(z)], &_rowSums[0], &_rowSumsSquared[0]);
+			}
+		}
+
+		const T* _voxels;
+		const tgt::svec3 _dimensions;
+		const size_t _radius;
+		const size_t _windowSize;
+		const size_t _planeSize;
+		const bool _needsSums;
+		const float _binScale;
+		const float _binOffset;
+		long _currentPlane;
+
+		std::vector<float> _intensities; // The ring buffer of the planes in the window
+		std::vector<const float*> _planeRows; // The current row in each plane of the window
+		std::vector<double> _planeSums; // The window sums of the planes in the ring buffer
+		std::vector<double> _planeSumsSquared;
+		std::vector<double> _sums; // The sums over the whole neighbourhood of the current plane
+		std::vector<double> _sumsSquared;
+		std::vector<double> _rowSums; // Scratch space for computeWindowSums
+		std::vector<double> _rowSumsSquared;
+	};
+
+	// Returns the coordinate c moved into [0, dimension)
+	size_t clampCoordinate(long c, size_t dimension) {
+		return static_cast<size_t>(std::min(std::max(c, 0L), static_cast<long>(dimension) - 1));
+	}
+
+	// The neighbourhood of the voxels whose (2*radius+1)^3 window reaches outside of the volume.
+	// The window is completed by repeating the voxels at the border of the volume, so these voxels
+	// get their real intensity and their measures from the same kernels as all other voxels. The
+	// clamped rows around a run of voxels are copied into a small block of their own, whose window
+	// sums are computed directly; that only happens at the border, so it doesn't need to be fast
+	template <typename T>
+	class ClampedNeighbourhood {
+	public:
+		ClampedNeighbourhood(const T* voxels, const tgt::svec3& dimensions, const ExtractionSettings& settings)
+			: _voxels(voxels)
+			, _dimensions(dimensions)
+			, _radius(settings.radius)
+			, _windowSize(2 * settings.radius + 1)
+			, _needsSums((settings.requirements & FeatureDescriptor::RequiresWindowSums) != 0)
+			, _binScale(settings.binScale)
+			, _binOffset(settings.binOffset)
+			, _planeRows(_windowSize)
+		{}
+
+		// Computes the measures of the voxels [xBegin, xEnd) of the row y in the plane z and writes
+		// them to the table, starting at the row rowStart + xBegin
+		void extract(FeatureTable& table, const std::vector<int>& features, const std::vector<FeatureRowKernel>& kernels,
+		             size_t rowStart, size_t y, size_t z, size_t xBegin, size_t xEnd)
+		{
+			if (xBegin >= xEnd)
+				return;
+			const size_t n = xEnd - xBegin;
+			const FeatureRowInput input = row(y, z, xBegin, xEnd);
+			for (size_t f = 0; f < features.size(); ++f) {
+				// The block is indexed by x - xBegin + radius
+				kernels[f](input, &_output[0], _radius, _radius + n);
+				if (table.isQuantized()) {
+					quantizeValues(&_output[_radius], table.quantizedColumn(features[f]) + rowStart + xBegin, n,
+					               table.quantization(features[f]));
+				}
+				else
+					std::copy(&_output[_radius], &_output[_radius] + n, table.column(features[f]) + rowStart + xBegin);
+			}
+		}
+
+	private:
+		// Fills the block with the clamped neighbourhood of the voxels [xBegin, xEnd) of the row y
+		// in the plane z and returns the kernel input for it
+		FeatureRowInput row(size_t y, size_t z, size_t xBegin, size_t xEnd) {
+			const long r = static_cast<long>(_radius);
+			const size_t rowLength = xEnd - xBegin + 2 * _radius;
+			_block.resize(_windowSize * _windowSize * rowLength);
+			_output.resize(rowLength);
+			for (size_t k = 0; k < _windowSize; ++k) {
+				const size_t clampedZ = clampCoordinate(static_cast<long>(z + k) - r, _dimensions.z);
+				for (size_t j = 0; j < _windowSize; ++j) {
+					const size_t clampedY = clampCoordinate(static_cast<long>(y + j) - r, _dimensions.y);
+					const T* source = _voxels + (clampedZ * _dimensions.y + clampedY) * _dimensions.x;
+					float* target = &_block[(k * _windowSize + j) * rowLength];
+					for (size_t i = 0; i < rowLength; ++i)
+						target[i] = static_cast<float>(source[clampCoordinate(static_cast<long>(xBegin + i) - r, _dimensions.x)]);
+				}
+			}
+
+			const size_t planeStride = _windowSize * rowLength;
+			const float* center = &_block[(_radius * _windowSize + _radius) * rowLength];
+			for (size_t p = 0; p < _windowSize; ++p)
+				_planeRows[p] = &_block[p * planeStride + _radius * rowLength];
+
+			if (_needsSums) {
+				// The sums over the (2*radius+1)^2 rows for each x, then over 2*radius+1 of those
+				_columnSums.assign(rowLength, 0.0);
+				_columnSumsSquared.assign(rowLength, 0.0);
+				for (size_t b = 0; b < _windowSize * _windowSize; ++b) {
+					const float* values = &_block[b * rowLength];
+					for (size_t i = 0; i < rowLength; ++i) {
+						_columnSums[i] += values[i];
+						_columnSumsSquared[i] += static_cast<double>(values[i]) * values[i];
+					}
+				}
+				_sums.assign(rowLength, 0.0);
+				_sumsSquared.assign(rowLength, 0.0);
+				for (size_t i = _radius; i < rowLength - _radius; ++i) {
+					for (size_t w = i - _radius; w <= i + _radius; ++w) {
+						_sums[i] += _columnSums[w];
+						_sumsSquared[i] += _columnSumsSquared[w];
+					}
+				}
+			}
+
+			FeatureRowInput input;
+			input.center = center;
+			input.previousY = center - rowLength;
+			input.nextY = center + rowLength;
+			input.previousZ = center - planeStride;
+			input.nextZ = center + planeStride;
+			input.planes = &_planeRows[0];
+			input.rowStride = rowLength;
+			input.radius = static_cast<int>(_radius);
+			input.sum = _needsSums ? &_sums[0] : 0;
+			input.sumSquared = _needsSums ? &_sumsSquared[0] : 0;
+			input.inverseCount = 1.0 / (_windowSize * _windowSize * _windowSize);
+			input.binScale = _binScale;
+			input.binOffset = _binOffset;
+			return input;
+		}
+
+		const T* _voxels;
+		const tgt::svec3 _dimensions;
+		const size_t _radius;
+		const size_t _windowSize;
+		const bool _needsSums;
+		const float _binScale;
+		const float _binOffset;
+
+		std::vector<float> _block; // The (2*radius+1)^2 clamped rows around the voxels
+		std::vector<const float*> _planeRows; // The center row of each plane of the block
+		std::vector<double> _columnSums; // The sums over the rows of the block for each x
+		std::vector<double> _columnSumsSquared;
+		std::vector<double> _sums; // The sums over the whole neighbourhood of each voxel
+		std::vector<double> _sumsSquared;
+		std::vector<float> _output; // The measure of the voxels, before it goes to the table
+	};
+
+	// Computes the measures the table has columns for, for all voxels in the z-planes
+	// [zBegin, zEnd) using a neighbourhood of (2*radius+1)^3 voxels. The measures of voxel i are
+	// written to the row i - firstRow of the table. Voxels whose neighbourhood reaches outside of
+	// the volume use a clamped neighbourhood, so every row of the planes is written. Different
+	// slabs touch disjoint rows of the table, so this function may be called concurrently. It is
+	// instantiated for every voxel type, so that each type gets its own loop without any virtual
+	// calls or type checks
+	template <typename T>
+	void extractSlab(const Volume* baseVolume, FeatureTable& table, size_t firstRow,
+	                 const ExtractionSettings& settings, size_t zBegin, size_t zEnd)
+	{
+		const VolumeAtomic<T>* volume = static_cast<const VolumeAtomic<T>*>(baseVolume);
+		const tgt::svec3 dimensions = volume->getDimensions();
+		const size_t planeSize = dimensions.x * dimensions.y;
+		const size_t r = static_cast<size_t>(settings.radius);
+		const size_t windowSize = 2 * r + 1;
+		const bool hasInterior = (dimensions.x >= windowSize && dimensions.y >= windowSize && dimensions.z >= windowSize);
+
+		// Look up the kernels of the requested measures once for the whole slab
+		const FeatureRegistry& registry = FeatureRegistry::instance();
+		std::vector<int> features;
+		std::vector<FeatureRowKernel> kernels;
+		for (int f = 0; f < registry.numFeatures(); ++f) {
+			if (table.hasFeature(f)) {
+				features.push_back(f);
+				kernels.push_back(registry.feature(f).kernel);
+			}
+		}
+
+		NeighbourhoodWindow<T> window(volume->voxel(), dimensions, settings);
+		ClampedNeighbourhood<T> border(volume->voxel(), dimensions, settings);
+
+		// The kernels only write floats, so for quantized tables each row is computed into a
+		// buffer first and quantized into the column from there
+		const bool quantized = table.isQuantized();
+		std::vector<float> rowBuffer(quantized ? dimensions.x : 0);
+
+		// iY is the index running over the 'y' dimension
+		// iZ is the index running over the 'z' dimension
+		// The kernel handles all x of a row at once, as the voxels are stored contiguously along x
+		for (size_t iZ = zBegin; iZ < zEnd; ++iZ) {
+			// The table contains one row per voxel, so the voxel with the index
+			// iZ*dimensions.x*dimensions.y + iY*dimensions.x + iX
+			// is stored in that row of the table, minus the firstRow offset
+			const size_t planeStart = iZ * planeSize - firstRow;
+			if (!hasInterior || iZ < r || iZ >= dimensions.z - r) {
+				for (size_t iY = 0; iY < dimensions.y; ++iY)
+					border.extract(table, features, kernels, planeStart + iY * dimensions.x, iY, iZ, 0, dimensions.x);
+				continue;
+			}
+
+			window.moveTo(iZ);
+			for (size_t iY = 0; iY < dimensions.y; ++iY) {
+				const size_t rowStart = planeStart + iY * dimensions.x;
+				if (iY < r || iY >= dimensions.y - r) {
+					border.extract(table, features, kernels, rowStart, iY, iZ, 0, dimensions.x);
+					continue;
+				}
+
+				// Each kernel writes its measure of the whole row of voxels straight into the
+				// measure's column; only the r voxels at either end are left for the border
+				const FeatureRowInput input = window.row(iY);
+				for (size_t f = 0; f < features.size(); ++f) {
+					float* row = quantized ? &rowBuffer[0] : table.column(features[f]) + rowStart;
+					kernels[f](input, row, r, dimensions.x - r);
+					if (quantized) {
+						quantizeValues(row + r, table.quantizedColumn(features[f]) + rowStart + r, dimensions.x - 2 * r,
+						               table.quantization(features[f]));
+					}
+				}
+				border.extract(table, features, kernels, rowStart, iY, iZ, 0, r);
+				border.extract(table, features, kernels, rowStart, iY, iZ, dimensions.x - r, dimensions.x);
+			}
+		}
+	}
+
+	// Returns the smallest and the largest intensity in the volume
+	template <typename T>
+	tgt::vec2 intensityRange(const Volume* baseVolume) {
+		const VolumeAtomic<T>* volume = static_cast<const VolumeAtomic<T>*>(baseVolume);
+		const T* voxels = volume->voxel();
+		const size_t nVoxels = volume->getNumVoxels();
+		if (nVoxels == 0)
+			return tgt::vec2(0.f, 0.f);
+
+		T minimum = voxels[0];
+		T maximum = voxels[0];
+		for (size_t i = 1; i < nVoxels; ++i) {
+			minimum = std::min(minimum, voxels[i]);
+			maximum = std::max(maximum, voxels[i]);
+		}
+		return tgt::vec2(static_cast<float>(minimum), static_cast<float>(maximum));
+	}
+
+	// One entry of the dispatch table for the scalar voxel types
+	struct SlabExtractor {
+		const char* format; // The name of the voxel format, as returned by Volume::getFormat()
+		void (*extract)(const Volume*, FeatureTable&, size_t, const ExtractionSettings&, size_t, size_t); // The specialized extraction
+		tgt::vec2 (*intensityRange)(const Volume*); // The range of the intensities in the volume
+	};
+
+	// Sorted by the name of the format, so that the extractor can be found with a binary search
+	const SlabExtractor slabExtractors[] = {
+		{ "double", &extractSlab<double>,   &intensityRange<double>   },
+		{ "float",  &extractSlab<float>,    &intensityRange<float>    },
+		{ "int16",  &extractSlab<int16_t>,  &intensityRange<int16_t>  },
+		{ "int32",  &extractSlab<int32_t>,  &intensityRange<int32_t>  },
+		{ "int8",   &extractSlab<int8_t>,   &intensityRange<int8_t>   },
+		{ "uint16", &extractSlab<uint16_t>, &intensityRange<uint16_t> },
+		{ "uint32", &extractSlab<uint32_t>, &intensityRange<uint32_t> },
+		{ "uint8",  &extractSlab<uint8_t>,  &intensityRange<uint8_t>  }
+	};
+
+	bool formatLess(const SlabExtractor& extractor, const std::string& format) {
+		return std::strcmp(extractor.format, format.c_str()) < 0;
+	}
+
+	// Returns the extractor for the format of the volume, or 0 if the format isn't supported
+	const SlabExtractor* findSlabExtractor(const Volume* volume) {
+		const std::string format = volume->getFormat();
+		const SlabExtractor* end = slabExtractors + sizeof(slabExtractors) / sizeof(slabExtractors[0]);
+		const SlabExtractor* extractor = std::lower_bound(slabExtractors, end, format, &formatLess);
+		if (extractor == end || format != extractor->format)
+			return 0;
+		return extractor;
+	}
+
+	// Mixes the value into the hash
+	uint64_t hashCombine(uint64_t hash, uint64_t value) {
+		hash = (hash ^ value) * FnvPrime;
+		return hash ^ (hash >> 32);
+	}
+
+	// A variant of FNV-1a that consumes eight bytes at a time. The extra shift after each step
+	// lets the high bits of a word influence the low bits of the hash, too
+	uint64_t hashBytes(const unsigned char* bytes, size_t nBytes) {
+		uint64_t hash = FnvOffsetBasis;
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= nBytes; i += sizeof(uint64_t)) {
+			uint64_t word;
+			std::memcpy(&word, bytes + i, sizeof(word));
+			hash = hashCombine(hash, word);
+		}
+		for (; i < nBytes; ++i)
+			hash = hashCombine(hash, bytes[i]);
+		return hash;
+	}
+
+	// Hashes the voxels of the volume. The chunks of the volume are hashed in parallel, but
+	// combined in a fixed order, so the hash doesn't depend on the thread count
+	uint64_t hashVolume(const Volume* volume, int nThreads) {
+		const unsigned char* bytes = static_cast<const unsigned char*>(volume->getData());
+		const size_t nBytes = volume->getNumBytes();
+		const long nChunks = static_cast<long>((nBytes + HashChunkSize - 1) / HashChunkSize);
+		std::vector<uint64_t> chunkHashes(nChunks);
+
+#ifdef _OPENMP
+		#pragma omp parallel for num_threads(nThreads)
+#endif
+		for (long chunk = 0; chunk < nChunks; ++chunk) {
+			const size_t begin = chunk * HashChunkSize;
+			chunkHashes[chunk] = hashBytes(bytes + begin, std::min(HashChunkSize, nBytes - begin));
+		}
+
+		uint64_t hash = FnvOffsetBasis;
+		for (long chunk = 0; chunk < nChunks; ++chunk)
+			hash = hashCombine(hash, chunkHashes[chunk]);
+		return hash;
+	}
+
+	// Computes the key under which the measures of the volume are cached. It covers everything
+	// the measures depend on: the voxels, given by their hash from hashVolume(), the dimensions
+	// and the format of the volume, the neighbourhood radius and the version of the extraction.
+	// The storage format and the quantization of the columns are part of it, too, so that the
+	// float and the quantized table of a volume are cached side by side. Which measures a cache
+	// file holds is stored in the file itself, so they are not part of the key
+	uint64_t computeCacheKey(uint64_t volumeHash, const Volume* volume, const SlabExtractor* extractor, int radius,
+	                         FeatureTable::StorageFormat format, const tgt::vec2& intensities)
+	{
+		const tgt::svec3 dimensions = volume->getDimensions();
+		uint64_t key = FnvOffsetBasis;
+		key = hashCombine(key, ExtractorVersion);
+		key = hashCombine(key, hashBytes(reinterpret_cast<const unsigned char*>(extractor->format),
+		                                 std::strlen(extractor->format)));
+		key = hashCombine(key, dimensions.x);
+		key = hashCombine(key, dimensions.y);
+		key = hashCombine(key, dimensions.z);
+		key = hashCombine(key, radius);
+		key = hashCombine(key, format);
+		if (format == FeatureTable::StorageUInt16) {
+			// The same ranges prepareTable() quantizes the columns with
+			const FeatureRegistry& registry = FeatureRegistry::instance();
+			for (int f = 0; f < registry.numFeatures(); ++f) {
+				const tgt::vec2 range = registry.feature(f).range(intensities, radius);
+				key = hashCombine(key, hashBytes(reinterpret_cast<const unsigned char*>(&range), sizeof(range)));
+			}
+		}
+		key = hashCombine(key, volumeHash);
+		// A key of 0 marks files that are not part of the cache
+		return key != 0 ? key : 1;
+	}
+
+	// The cache file of a key is named after the key's hexadecimal digits
+	std::string cacheFilePath(const std::string& directory, uint64_t key) {
+		std::ostringstream path;
+		if (!directory.empty())
+			path << directory << "/";
+		path << std::hex << std::setw(16) << std::setfill('0') << key << ".tnmf";
+		return path.str();
+	}
+
+	// Gives the table nRows rows for the measures in the storage format. A quantized column covers
+	// the whole range the registry gives for its measure, so that all bricks and all runs on the
+	// same volume share the same quantization
+	void prepareTable(FeatureTable& table, size_t nRows, FeatureSet features, FeatureTable::StorageFormat format,
+	                  const tgt::vec2& intensities, int radius)
+	{
+		table.resize(nRows, false, features, format);
+		if (format != FeatureTable::StorageUInt16)
+			return;
+		const FeatureRegistry& registry = FeatureRegistry::instance();
+		for (int f = 0; f < registry.numFeatures(); ++f) {
+			if (containsFeature(features, f)) {
+				const tgt::vec2 range = registry.feature(f).range(intensities, radius);
+				table.setQuantization(f, FeatureTable::Quantization::fromRange(range.x, range.y));
+			}
+		}
+	}
+
+	// Writes the table to the cache. The file is written under a temporary name first and only
+	// renamed once it is complete, so that an interrupted write never leaves a broken cache file
+	bool writeCacheFile(const std::string& path, uint64_t key, const FeatureTable& table) {
+		const std::string partialPath = path + ".partial";
+		FeatureFileWriter writer;
+		const bool written = writer.open(partialPath, table.size(), table, key)
+			&& writer.writeRows(0, table);
+		writer.close();
+		if (!written) {
+			std::remove(partialPath.c_str());
+			return false;
+		}
+		// rename doesn't replace existing files on Windows
+		std::remove(path.c_str());
+		return std::rename(partialPath.c_str(), path.c_str()) == 0;
+	}
+
+	// Extracts the measures of the voxels of the planes [zBegin, zEnd) into the table.
+	// The planes are cut into slabs of whole xy-planes. Each slab writes only the rows of its own
+	// planes, so the slabs can run concurrently without locking. The neighbourhood sums are
+	// computed such that the result does not depend on the number of threads either
+	void extractPlanes(const SlabExtractor* extractor, const Volume* volume, FeatureTable& table,
+	                   size_t firstRow, const ExtractionSettings& settings, size_t zBegin, size_t zEnd,
+	                   int nThreads)
+	{
+		if (zBegin >= zEnd)
+			return;
+
+		const long nPlanes = static_cast<long>(zEnd - zBegin);
+		// A few more slabs than threads keeps all cores busy when the planes differ in cost
+		const long nSlabs = std::min<long>(nPlanes, nThreads * SlabsPerThread);
+
+#ifdef _OPENMP
+		#pragma omp parallel for num_threads(nThreads) schedule(dynamic, 1)
+#endif
+		for (long slab = 0; slab < nSlabs; ++slab) {
+			const size_t slabBegin = zBegin + static_cast<size_t>(slab * nPlanes / nSlabs);
+			const size_t slabEnd = zBegin + static_cast<size_t>((slab + 1) * nPlanes / nSlabs);
+			extractor->extract(volume, table, firstRow, settings, slabBegin, slabEnd);
+		}
 	}
 
 }
@@ -18,139 +592,181 @@ TNMVolumeInformation::TNMVolumeInformation()
     : Processor()
     , _inport(Port::INPORT, "in.volume")
     , _outport(Port::OUTPORT, "out.data")
-    , _data(0)
+    , _numThreads("numThreads", "Number of Threads", defaultNumThreads(), 1, 64)
+    , _neighbourhoodRadius("neighbourhoodRadius", "Neighbourhood Radius", 1, 1, MaxNeighbourhoodRadius)
+    , _storageFormat("storageFormat", "Storage Format")
+    , _streamToDisk("streamToDisk", "Stream to Disk", false)
+    , _spillFile("spillFile", "Spill File", "Select the file the measures are streamed to",
+                 "tnm093_features.tnmf", "Feature files (*.tnmf)", FileDialogProperty::SAVE_FILE)
+    , _brickDepth("brickDepth", "Planes per Brick", 16, 1, 1024)
+    , _useCache("useCache", "Use Feature Cache", false)
+    , _cacheDirectory("cacheDirectory", "Cache Directory", "Select the directory the measures are cached in",
+                      ".", "", FileDialogProperty::DIRECTORY)
+    , _buildPyramid("buildPyramid", "Build Level of Detail", false)
+    , _table(0)
+    , _hashedVolume(0)
+    , _volumeHash(0)
 {
+	// Quantizing the measures to 16 bits halves the memory of the table and of the plots' vertex buffers
+    _storageFormat.addOption("float32", "32 bit Float", FeatureTable::StorageFloat32);
+    _storageFormat.addOption("uint16", "16 bit Quantized", FeatureTable::StorageUInt16);
+
     addPort(_inport);
     addPort(_outport);
+    addProperty(_numThreads);
+    addProperty(_neighbourhoodRadius);
+    addProperty(_storageFormat);
+    addProperty(_streamToDisk);
+    addProperty(_spillFile);
+    addProperty(_brickDepth);
+    addProperty(_useCache);
+    addProperty(_cacheDirectory);
+    addProperty(_buildPyramid);
 }
 
 TNMVolumeInformation::~TNMVolumeInformation() {
-    delete _data;
+    delete _table;
 }
 
 void TNMVolumeInformation::process() {
     const VolumeHandleBase* volumeHandle = _inport.getData();
-    const Volume* baseVolume = volumeHandle->getRepresentation<Volume>();
-    const VolumeUInt16* volume = dynamic_cast<const VolumeUInt16*>(baseVolume);
+    const Volume* volume = volumeHandle->getRepresentation<Volume>();
     if (volume == 0)
         return;
+
+	// Find the extraction that was compiled for the voxel type of this volume
+    const SlabExtractor* extractor = findSlabExtractor(volume);
+    if (extractor == 0) {
+        LWARNING("Only volumes with a single scalar channel are supported");
+        return;
+    }
 	// If we get this far, there actually is a volume to work with
 
-	// If this is the first call, we will create the Data object
-	if (_data == 0)
-        _data = new Data;
+	// If this is the first call, we will create the FeatureTable object
+	if (_table == 0)
+        _table = new FeatureTable;
 
 	// Retrieve the size of the three dimensions of the volume
     const tgt::svec3 dimensions = volume->getDimensions();
-	// Create as many data entries as there are voxels in the volume
-    _data->resize(dimensions.x * dimensions.y * dimensions.z);
-
-	// iX is the index running over the 'x' dimension
-	// iY is the index running over the 'y' dimension
-	// iZ is the index running over the 'z' dimension
-    for (size_t iX = 1; iX < dimensions.x-1; ++iX) {
-        for (size_t iY = 1; iY < dimensions.y-1; ++iY) {
-            for (size_t iZ = 1; iZ < dimensions.z-1; ++iZ) {
-				// i is a unique identifier for the voxel calculated by the following
-				// (probably one of the most important) formulas:
-				// iZ*dimensions.x*dimensions.y + iY*dimensions.x + iX;
-                const size_t i = VolumeUInt16::calcPos(volume->getDimensions(), tgt::svec3(iX, iY, iZ));
-
-		// Setting the unique identifier as the voxelIndex
-		_data->at(i).voxelIndex = i;
-//
-		// use iX, iY, iZ, i, and the VolumeUInt16::voxel method to derive the measures here
-
-		int v[3][3][3] = {0};
-		v[0][0][0] = volume->voxel(iX-1, iY-1, iZ-1);
-		v[0][0][1] = volume->voxel(iX-1, iY-1, iZ);
-		v[0][0][2] = volume->voxel(iX-1, iY-1, iZ+1);
-		v[0][1][0] = volume->voxel(iX-1, iY, iZ);
-		v[0][1][1] = volume->voxel(iX-1, iY, iZ);
-		v[0][1][2] = volume->voxel(iX-1, iY, iZ+1);
-		v[0][2][0] = volume->voxel(iX-1, iY+1, iZ);
-		v[0][2][1] = volume->voxel(iX-1, iY+1, iZ);
-		v[0][2][2] = volume->voxel(iX-1, iY+1, iZ+1);
-		v[1][0][0] = volume->voxel(iX, iY-1, iZ-1);
-		v[1][0][1] = volume->voxel(iX, iY-1, iZ);
-		v[1][0][2] = volume->voxel(iX, iY-1, iZ+1);
-		v[1][1][0] = volume->voxel(iX, iY, iZ-1);
-		v[1][1][1] = volume->voxel(iX, iY, iZ);
-		v[1][1][2] = volume->voxel(iX, iY, iZ+1);
-		v[1][2][0] = volume->voxel(iX, iY+1, iZ);
-		v[1][2][1] = volume->voxel(iX, iY+1, iZ);
-		v[1][2][2] = volume->voxel(iX, iY+1, iZ+1);
-		v[2][0][0] = volume->voxel(iX+1, iY-1, iZ-1);
-		v[2][0][1] = volume->voxel(iX+1, iY-1, iZ);
-		v[2][0][2] = volume->voxel(iX+1, iY-1, iZ+1);
-		v[2][1][0] = volume->voxel(iX+1, iY, iZ);
-		v[2][1][1] = volume->voxel(iX+1, iY, iZ);
-		v[2][1][2] = volume->voxel(iX+1, iY, iZ+1);
-		v[2][2][0] = volume->voxel(iX+1, iY+1, iZ);
-		v[2][2][1] = volume->voxel(iX+1, iY+1, iZ);
-		v[2][2][2] = volume->voxel(iX+1, iY+1, iZ+1);
-
-
-		// Intensity
-		//
-		float intensity = -1.f;
-		intensity = volume->voxel(i);
-		// Retrieve the intensity using the 'VolumeUInt16's voxel method
-		//
-		_data->at(i).dataValues[0] = intensity;
-
-		//
-		// Average
-		//
-		float average = 0.0f;
-		// Compute the average; the voxel method accepts both a single parameter
-
-		
-		for(int i = 0; i < 3;  i++)
-		  for(int j = 0; j < 3;  j++)
-		    for(int k = 0; k < 3; k++)
-		      average += v[i][j][k];
-    
-		average /= 27.0f;
-
-		_data->at(i).dataValues[1] = average;
-
-		//
-		// Standard deviation
-		//
-		float stdDeviation = 0.f;
-		// Compute the standard deviation
-		for(int i = 0; i < 3;  i++)
-		  for(int j = 0; j < 3;  j++)
-		    for(int k = 0; k < 3; k++)
-		      stdDeviation += (pow(v[i][j][k]-average,2));
-		stdDeviation = sqrt(stdDeviation);
-
-		_data->at(i).dataValues[2] = stdDeviation;
-
-		//
-		// Gradient magnitude
-		//
-		float gradientMagnitude = -1.f;
-		// Compute the gradient direction using either forward, central, or backward
-		// calculation and then take the magnitude (=length) of the vector.
-		// Hint:  tgt::vec3 is a class that can calculate the length for you
-		float xVal = (v[2][1][1] - v[0][1][1])/2;
-		float yVal = (v[1][2][1] - v[1][0][1])/2;
-		float zVal = (v[1][1][2] - v[1][1][0])/2;
-
-		gradientMagnitude = length(tgt::vec3(xVal*xVal + yVal*yVal + zVal*zVal));
-
-		_data->at(i).dataValues[3] = gradientMagnitude;
-            }
+    const size_t nVoxels = dimensions.x * dimensions.y * dimensions.z;
+
+    const int radius = _neighbourhoodRadius.get();
+    const int nThreads = std::max(_numThreads.get(), 1);
+
+	// Only compute the measures the connected processors actually use
+    FeatureSet features = requestedFeatures(_outport);
+    const FeatureTable::StorageFormat format = static_cast<FeatureTable::StorageFormat>(_storageFormat.getValue());
+	// The quantization is derived from the intensity range, so for quantized tables it is part
+	// of the cache key, too
+    tgt::vec2 intensities(0.f, 0.f);
+    bool hasIntensities = false;
+    if (format == FeatureTable::StorageUInt16) {
+        intensities = extractor->intensityRange(volume);
+        hasIntensities = true;
+    }
+
+	// If the measures of this volume were computed before, the table is mapped from the cache
+	// file. The columns are then only paged in from the disk when they are actually used. Streamed
+	// tables are not cached, as the spill file already holds them
+    const bool useCache = _useCache.get() && !_streamToDisk.get();
+    uint64_t cacheKey = 0;
+    std::string cachePath;
+    if (useCache) {
+		// Hashing the voxels is the expensive part of the key, so it is only done again when
+		// there is a new volume on the inport
+        if (_inport.hasChanged() || volume != _hashedVolume) {
+            _volumeHash = hashVolume(volume, nThreads);
+            _hashedVolume = volume;
         }
+        cacheKey = computeCacheKey(_volumeHash, volume, extractor, radius, format, intensities);
+        cachePath = cacheFilePath(_cacheDirectory.get(), cacheKey);
+        if (_table->mapCacheFile(cachePath, cacheKey, features, format)) {
+            updatePyramid(dimensions, nThreads);
+            _outport.setData(_table, false);
+            return;
+        }
+		// The file that is written replaces a cache file of this volume that lacks some of the
+		// measures. It keeps that file's measures, too, so that switching between measures
+		// doesn't compute them over and over again
+        FeatureFileHeader cached;
+        if (cached.read(cachePath) && cached.cacheKey == cacheKey
+            && cached.storageFormat == static_cast<uint32_t>(format))
+        {
+            features |= cached.features;
+        }
+    }
+
+    ExtractionSettings settings;
+    settings.radius = radius;
+    settings.requirements = FeatureRegistry::instance().requirements(features);
+    settings.binScale = 0.f;
+    settings.binOffset = 0.f;
+    if (settings.requirements & FeatureDescriptor::RequiresIntensityRange) {
+        if (!hasIntensities)
+            intensities = extractor->intensityRange(volume);
+        if (intensities.y > intensities.x)
+            settings.binScale = LocalEntropyBins / (intensities.y - intensities.x);
+        settings.binOffset = intensities.x;
+    }
+
+    if (!_streamToDisk.get()) {
+		// Create as many rows as there are voxels in the volume. Row i belongs to voxel i, so there
+		// is no need for an index column and the table is sorted by the voxel index by construction.
+		// When the volume is processed again, the columns of the last run are reused and simply
+		// overwritten, as the extraction writes every row
+        prepareTable(*_table, nVoxels, features, format, intensities, radius);
+        extractPlanes(extractor, volume, *_table, 0, settings, 0, dimensions.z, nThreads);
+
+        if (useCache && !writeCacheFile(cachePath, cacheKey, *_table))
+            LWARNING("Could not write cache file " << cachePath);
     }
+    else {
+		// The volume is processed in bricks of whole planes and each brick is written to the spill
+		// file before the next one is computed, so only one brick of measures is in memory at a
+		// time. The neighbourhood of the voxels at the brick's border is read from the adjacent
+		// planes of the volume, which act as the halo of the brick. Only the measures are
+		// streamed; the input volume itself still has to fit into memory
+        const std::string path = _spillFile.get();
+        const size_t planeSize = dimensions.x * dimensions.y;
+        const size_t brickDepth = static_cast<size_t>(_brickDepth.get());
+
+		// The brick is prepared before the file is opened, as it determines the file's layout
+        prepareTable(_brick, std::min(brickDepth, dimensions.z) * planeSize, features, format, intensities, radius);
+        FeatureFileWriter writer;
+        if (!writer.open(path, nVoxels, _brick)) {
+            LERROR("Could not create spill file " << path);
+            return;
+        }
 
-	// sort the data by the voxel index for faster processing later
-	std::sort(_data->begin(), _data->end(), sortByIndex);
+        for (size_t brickBegin = 0; brickBegin < dimensions.z; brickBegin += brickDepth) {
+            const size_t brickEnd = std::min(brickBegin + brickDepth, dimensions.z);
+            const size_t firstRow = brickBegin * planeSize;
+            prepareTable(_brick, (brickEnd - brickBegin) * planeSize, features, format, intensities, radius);
+            extractPlanes(extractor, volume, _brick, firstRow, settings, brickBegin, brickEnd, nThreads);
+            if (!writer.writeRows(firstRow, _brick)) {
+                LERROR("Could not write to spill file " << path);
+                return;
+            }
+        }
+        writer.close();
+
+		// The table on the outport now refers to the spill file
+        _table->attachSpillFile(path, nVoxels, _brick);
+    }
 
 	// And provide access to the data using the outport
-    _outport.setData(_data, false);
+    updatePyramid(dimensions, nThreads);
+    _outport.setData(_table, false);
+}
+
+void TNMVolumeInformation::updatePyramid(const tgt::svec3& dimensions, int nThreads) {
+	// Spilled tables are never drawn directly, so they don't need a pyramid either
+    if (_buildPyramid.get() && _table->isResident()) {
+        _pyramid.build(*_table, dimensions, nThreads);
+        _table->setPyramid(&_pyramid);
+    }
+    else
+        _pyramid.clear();
 }
 
 } // namespace
@@ -0,0 +1,207 @@
+// A regression test of the binned bitmap index against a linear scan over the values. Ranges
+// are chosen at random and on the edges of the bins, where the binning has to round, over
+// columns with values on the bin edges, at the ends of the range and not a number. For every
+// range, select() and narrow() must keep exactly the rows a linear scan keeps. The test returns
+// a non-zero exit code if any selection differs from the reference
+
+#include "modules/tnm093/include/tnm_bitmapindex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <math.h>
+#include <vector>
+
+using namespace voreen;
+
+namespace {
+	// The row counts that are tested; around the word size of the bitmaps and larger
+	const size_t RowCounts[] = { 0, 1, 63, 64, 65, 1000, 4099 };
+	const size_t NumColumns = 3;
+
+	// The number of random ranges per table
+	const int RandomRanges = 200;
+
+	const float NotANumber = std::numeric_limits<float>::quiet_NaN();
+
+	float randomFloat(float minimum, float maximum) {
+		return minimum + static_cast<float>(std::rand()) / RAND_MAX * (maximum - minimum);
+	}
+
+	// The lower edge of the bin b of the index over [minimum, maximum]
+	float binEdge(float minimum, float maximum, int b) {
+		return minimum + b * (maximum - minimum) / BinnedBitmapIndex::NumBins;
+	}
+
+	// A value of [minimum, maximum]: mostly random, but also the ends of the range, the edges of
+	// the bins, the floats right next to them, and not a number
+	float makeValue(float minimum, float maximum) {
+		const int b = std::rand() % (BinnedBitmapIndex::NumBins + 1);
+		switch (std::rand() % 8) {
+			case 0:
+				return minimum;
+			case 1:
+				return maximum;
+			case 2:
+				return binEdge(minimum, maximum, b);
+			case 3:
+				return std::max(minimum, nextafterf(binEdge(minimum, maximum, b), -std::numeric_limits<float>::max()));
+			case 4:
+				return std::min(maximum, nextafterf(binEdge(minimum, maximum, b), std::numeric_limits<float>::max()));
+			case 5:
+				return NotANumber;
+			default:
+				return randomFloat(minimum, maximum);
+		}
+	}
+
+	// A bound of a range: the same kinds of values as in the table, and some beyond its ends
+	float makeBound(float minimum, float maximum) {
+		const float width = maximum - minimum;
+		switch (std::rand() % 6) {
+			case 0:
+				return randomFloat(minimum - width, maximum + width);
+			case 1:
+				return (std::rand() % 2) ? minimum - 1.f : maximum + 1.f;
+			default: {
+				const float value = makeValue(minimum, maximum);
+				return (value == value) ? value : minimum;
+			}
+		}
+	}
+
+	// Whether the row passes the ranges of all columns, the way BinnedBitmapIndex defines it
+	bool passes(const std::vector<float>& values, size_t row, const float* lower, const float* upper,
+	            float minimum, float maximum)
+	{
+		for (size_t c = 0; c < NumColumns; ++c) {
+			const bool coversAll = lower[c] <= minimum && upper[c] >= maximum;
+			const float value = values[row * NumColumns + c];
+			if (!coversAll && !(value >= lower[c] && value <= upper[c]))
+				return false;
+		}
+		return true;
+	}
+
+	bool isSelected(const std::vector<uint64_t>& selection, size_t row) {
+		return (selection[row / 64] & (uint64_t(1) << (row % 64))) != 0;
+	}
+
+	// Compares a selection with the reference and returns the number of rows that differ; bits
+	// beyond the last row must not be set either
+	int compare(const std::vector<uint64_t>& selection, const std::vector<bool>& reference, const char* name,
+	            const float* lower, const float* upper)
+	{
+		int failures = 0;
+		if (selection.size() != (reference.size() + 63) / 64) {
+			std::printf("%s: %d words for %d rows\n", name, static_cast<int>(selection.size()),
+			            static_cast<int>(reference.size()));
+			return 1;
+		}
+		for (size_t row = 0; row < selection.size() * 64; ++row) {
+			const bool expected = row < reference.size() && reference[row];
+			if (isSelected(selection, row) != expected) {
+				if (failures < 10) {
+					std::printf("%s, %d rows, row %d: selected %d (expected %d), ranges [%g, %g] [%g, %g] [%g, %g]\n",
+					            name, static_cast<int>(reference.size()), static_cast<int>(row),
+					            isSelected(selection, row), expected, lower[0], upper[0], lower[1], upper[1],
+					            lower[2], upper[2]);
+				}
+				++failures;
+			}
+		}
+		return failures;
+	}
+
+	int testRanges(const BinnedBitmapIndex& index, const BinnedBitmapIndex& otherIndex,
+	               const std::vector<float>& values, const std::vector<float>& otherValues,
+	               const float* lower, const float* upper, const float* otherLower, const float* otherUpper,
+	               float minimum, float maximum)
+	{
+		const size_t nRows = index.numRows();
+		std::vector<bool> reference(nRows);
+		std::vector<bool> combined(nRows);
+		for (size_t row = 0; row < nRows; ++row) {
+			reference[row] = passes(values, row, lower, upper, minimum, maximum);
+			combined[row] = reference[row] && passes(otherValues, row, otherLower, otherUpper, minimum, maximum);
+		}
+
+		std::vector<uint64_t> selection;
+		index.select(lower, upper, selection);
+		int failures = compare(selection, reference, "select", lower, upper);
+		// Narrowing the selection with a second index over the same rows gives the rows in both
+		otherIndex.narrow(otherLower, otherUpper, selection);
+		failures += compare(selection, combined, "narrow", otherLower, otherUpper);
+		return failures;
+	}
+
+	int testTable(size_t nRows, float minimum, float maximum) {
+		std::vector<float> values(nRows * NumColumns);
+		std::vector<float> otherValues(nRows * NumColumns);
+		for (size_t i = 0; i < values.size(); ++i) {
+			values[i] = (minimum == maximum) ? ((std::rand() % 8 == 0) ? NotANumber : minimum) : makeValue(minimum, maximum);
+			otherValues[i] = (minimum == maximum) ? minimum : makeValue(minimum, maximum);
+		}
+		BinnedBitmapIndex index;
+		index.build(values.empty() ? 0 : &values[0], nRows, NumColumns, minimum, maximum);
+		BinnedBitmapIndex otherIndex;
+		otherIndex.build(otherValues.empty() ? 0 : &otherValues[0], nRows, NumColumns, minimum, maximum);
+
+		int failures = 0;
+		float lower[NumColumns];
+		float upper[NumColumns];
+		float otherLower[NumColumns];
+		float otherUpper[NumColumns];
+
+		// Every range between two bin edges, and the ranges that end right next to them
+		for (int first = 0; first <= BinnedBitmapIndex::NumBins; ++first) {
+			for (int last = first; last <= BinnedBitmapIndex::NumBins; ++last) {
+				for (size_t c = 0; c < NumColumns; ++c) {
+					const float low = binEdge(minimum, maximum, first);
+					const float high = binEdge(minimum, maximum, last);
+					lower[c] = (c == 1) ? nextafterf(low, std::numeric_limits<float>::max()) : low;
+					upper[c] = (c == 2) ? nextafterf(high, -std::numeric_limits<float>::max()) : high;
+					otherLower[c] = minimum;
+					otherUpper[c] = high;
+				}
+				failures += testRanges(index, otherIndex, values, otherValues, lower, upper, otherLower, otherUpper,
+				                       minimum, maximum);
+			}
+		}
+
+		// Random ranges, some of them empty or covering all values
+		for (int i = 0; i < RandomRanges; ++i) {
+			for (size_t c = 0; c < NumColumns; ++c) {
+				lower[c] = makeBound(minimum, maximum);
+				upper[c] = (std::rand() % 8 == 0) ? lower[c] - 1.f : makeBound(minimum, maximum);
+				if (std::rand() % 4 == 0 && lower[c] > upper[c])
+					std::swap(lower[c], upper[c]);
+				otherLower[c] = makeBound(minimum, maximum);
+				otherUpper[c] = std::max(otherLower[c], makeBound(minimum, maximum));
+			}
+			if (i % 50 == 0)
+				lower[i / 50 % NumColumns] = NotANumber;
+			failures += testRanges(index, otherIndex, values, otherValues, lower, upper, otherLower, otherUpper,
+			                       minimum, maximum);
+		}
+		return failures;
+	}
+}
+
+int main() {
+	std::srand(18);
+	int failures = 0;
+	for (size_t i = 0; i < sizeof(RowCounts) / sizeof(RowCounts[0]); ++i) {
+		failures += testTable(RowCounts[i], 0.f, 1.f);
+		failures += testTable(RowCounts[i], -37.5f, 4095.f);
+		failures += testTable(RowCounts[i], 3.f, 3.f);
+	}
+	if (failures > 0) {
+		std::printf("FAILED: %d rows differ from the reference\n", failures);
+		return 1;
+	}
+	std::printf("All selections of the bitmap index match the reference\n");
+	return 0;
+}
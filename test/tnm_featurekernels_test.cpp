@@ -0,0 +1,158 @@
+// A regression test of the feature kernels against a brute-force evaluation of the measures. For
+// every radius the kernels support, the average and the standard deviation computed from the
+// running window sums must match summing up the whole neighbourhood of each voxel, and the
+// gradient magnitude must match the length of the central difference vector. The test returns
+// a non-zero exit code if any voxel differs by more than the tolerance
+
+#include "modules/tnm093/include/tnm_featurekernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace voreen;
+
+namespace {
+	// The dimensions of the test volume; not multiples of the vector widths, so that the scalar
+	// tails of the rows are tested, too
+	const size_t DimX = 23;
+	const size_t DimY = 19;
+	const size_t DimZ = 17;
+
+	// The largest relative difference that is accepted
+	const double Tolerance = 1e-5;
+
+	// A volume of random values, either whole numbers like those of integer volumes or fractions
+	std::vector<float> makeVolume(bool integers, unsigned int seed) {
+		std::srand(seed);
+		std::vector<float> volume(DimX * DimY * DimZ);
+		for (size_t i = 0; i < volume.size(); ++i) {
+			if (integers)
+				volume[i] = static_cast<float>(std::rand() % 4096);
+			else
+				volume[i] = static_cast<float>(std::rand()) / RAND_MAX * 100.f - 50.f;
+		}
+		return volume;
+	}
+
+	float voxel(const std::vector<float>& volume, size_t x, size_t y, size_t z) {
+		return volume[(z * DimY + y) * DimX + x];
+	}
+
+	bool matches(double value, double reference) {
+		return std::abs(value - reference) <= Tolerance * std::max(1.0, std::abs(reference));
+	}
+
+	// Compares the kernels with the brute-force measures for all voxels with a complete
+	// neighbourhood and returns the number of voxels that differ
+	int testVolume(const std::vector<float>& volume, int radius, const char* name) {
+		const size_t r = static_cast<size_t>(radius);
+		const size_t windowSize = 2 * r + 1;
+		const size_t planeSize = DimX * DimY;
+
+		// The window sums of each plane, added up over the planes of the neighbourhood the same
+		// way the extraction does
+		std::vector<double> planeSums(DimZ * planeSize, 0.0);
+		std::vector<double> planeSumsSquared(DimZ * planeSize, 0.0);
+		std::vector<double> rowSum(planeSize);
+		std::vector<double> rowSumSquared(planeSize);
+		for (size_t z = 0; z < DimZ; ++z) {
+			computeWindowSums(&volume[z * planeSize], DimX, DimY, radius, &planeSums[z * planeSize],
+			                  &planeSumsSquared[z * planeSize], &rowSum[0], &rowSumSquared[0]);
+		}
+
+		int failures = 0;
+		std::vector<double> sums(planeSize);
+		std::vector<double> sumsSquared(planeSize);
+		std::vector<const float*> planes(windowSize);
+		std::vector<float> average(DimX);
+		std::vector<float> stdDeviation(DimX);
+		std::vector<float> gradient(DimX);
+		for (size_t z = r; z < DimZ - r; ++z) {
+			std::fill(sums.begin(), sums.end(), 0.0);
+			std::fill(sumsSquared.begin(), sumsSquared.end(), 0.0);
+			for (size_t p = z - r; p <= z + r; ++p) {
+				for (size_t i = 0; i < planeSize; ++i) {
+					sums[i] += planeSums[p * planeSize + i];
+					sumsSquared[i] += planeSumsSquared[p * planeSize + i];
+				}
+			}
+
+			for (size_t y = r; y < DimY - r; ++y) {
+				const size_t offset = y * DimX;
+				for (size_t p = 0; p < windowSize; ++p)
+					planes[p] = &volume[(z - r + p) * planeSize + offset];
+
+				FeatureRowInput input;
+				input.center = &volume[z * planeSize + offset];
+				input.previousY = input.center - DimX;
+				input.nextY = input.center + DimX;
+				input.previousZ = input.center - planeSize;
+				input.nextZ = input.center + planeSize;
+				input.planes = &planes[0];
+				input.rowStride = DimX;
+				input.radius = radius;
+				input.sum = &sums[offset];
+				input.sumSquared = &sumsSquared[offset];
+				input.inverseCount = 1.0 / (windowSize * windowSize * windowSize);
+				input.binScale = 0.f;
+				input.binOffset = 0.f;
+				computeAverageRow(input, &average[0], r, DimX - r);
+				computeStdDeviationRow(input, &stdDeviation[0], r, DimX - r);
+				computeGradientMagnitudeRow(input, &gradient[0], r, DimX - r);
+
+				for (size_t x = r; x < DimX - r; ++x) {
+					// The definitions the measures had before the running sums: the mean of the
+					// neighbourhood and sqrt(sum((v - mean)^2))
+					double sum = 0.0;
+					for (size_t k = z - r; k <= z + r; ++k)
+						for (size_t j = y - r; j <= y + r; ++j)
+							for (size_t i = x - r; i <= x + r; ++i)
+								sum += voxel(volume, i, j, k);
+					const double mean = sum / (windowSize * windowSize * windowSize);
+					double squaredDeviation = 0.0;
+					for (size_t k = z - r; k <= z + r; ++k)
+						for (size_t j = y - r; j <= y + r; ++j)
+							for (size_t i = x - r; i <= x + r; ++i)
+								squaredDeviation += (voxel(volume, i, j, k) - mean) * (voxel(volume, i, j, k) - mean);
+					const double deviation = std::sqrt(squaredDeviation);
+
+					const double dx = (voxel(volume, x + 1, y, z) - voxel(volume, x - 1, y, z)) * 0.5;
+					const double dy = (voxel(volume, x, y + 1, z) - voxel(volume, x, y - 1, z)) * 0.5;
+					const double dz = (voxel(volume, x, y, z + 1) - voxel(volume, x, y, z - 1)) * 0.5;
+					const double gradientMagnitude = std::sqrt(dx*dx + dy*dy + dz*dz);
+
+					if (!matches(average[x], mean) || !matches(stdDeviation[x], deviation)
+						|| !matches(gradient[x], gradientMagnitude))
+					{
+						if (failures < 10) {
+							std::printf("%s, radius %d, voxel (%d, %d, %d): average %g (expected %g), standard deviation %g "
+							            "(expected %g), gradient magnitude %g (expected %g)\n", name, radius,
+							            static_cast<int>(x), static_cast<int>(y), static_cast<int>(z), average[x], mean,
+							            stdDeviation[x], deviation, gradient[x], gradientMagnitude);
+						}
+						++failures;
+					}
+				}
+			}
+		}
+		return failures;
+	}
+}
+
+int main() {
+	std::printf("Testing the feature kernels with SIMD level %d\n", static_cast<int>(featureKernelSimdLevel()));
+	int failures = 0;
+	for (int radius = 1; radius <= MaxNeighbourhoodRadius; ++radius) {
+		failures += testVolume(makeVolume(true, radius), radius, "integer volume");
+		failures += testVolume(makeVolume(false, radius), radius, "float volume");
+	}
+	if (failures > 0) {
+		std::printf("FAILED: %d voxels differ from the reference\n", failures);
+		return 1;
+	}
+	std::printf("All feature kernels match the reference\n");
+	return 0;
+}
@@ -0,0 +1,13 @@
+# A standalone regression test of the feature kernels; it doesn't need the rest of Voreen.
+# Build and run it from this directory with: qmake && make && ./tnm_featurekernels_test
+TEMPLATE = app
+TARGET = tnm_featurekernels_test
+CONFIG += console
+CONFIG -= qt app_bundle
+
+# The sources include the module's headers relative to the Voreen root
+INCLUDEPATH += $$PWD/../../..
+
+SOURCES += \
+    tnm_featurekernels_test.cpp \
+    ../src/tnm_featurekernels.cpp
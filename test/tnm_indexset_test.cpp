@@ -0,0 +1,269 @@
+// A regression test of the index set against a std::set of the same indices. The sets are built
+// from random indices around the chunk boundaries at multiples of 65536, above 2^32 and at the
+// end of the range, sparse enough to be stored as arrays and dense enough to be stored as
+// bitmaps, so that the chunks change between the two. Every set must contain, iterate and count
+// the same indices as its reference after insert(), erase(), the union, intersection and
+// difference and changesSince(), and copies must not change when the set they share their
+// chunks with is changed. The test returns a non-zero exit code if any set differs from the
+// reference
+
+#include "modules/tnm093/include/tnm_indexset.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <set>
+#include <vector>
+
+using namespace voreen;
+
+namespace {
+	typedef std::set<uint64_t> Reference;
+
+	// The chunks the indices are drawn from: the first ones, both sides of 2^32, and the last one
+	const uint64_t ChunkKeys[] = { 0, 1, 2, 65535, 65536, 65537, uint64_t(0xFFFFFFFFFFFF) };
+	const size_t NumChunkKeys = sizeof(ChunkKeys) / sizeof(ChunkKeys[0]);
+
+	// The number of indices per chunk that are tested; around the largest array of 4096 values,
+	// and a full chunk
+	const size_t ChunkCounts[] = { 1, 100, 4095, 4096, 4097, 20000, 65536 };
+	const size_t NumChunkCounts = sizeof(ChunkCounts) / sizeof(ChunkCounts[0]);
+
+	// The number of random sets per test
+	const int RandomSets = 20;
+
+	uint64_t randomValue(size_t range) {
+		return static_cast<uint64_t>((static_cast<size_t>(std::rand()) * (RAND_MAX + size_t(1))
+		                              + static_cast<size_t>(std::rand())) % range);
+	}
+
+	// A lower 16 bits that is often at the ends of the chunk, where the boundaries are
+	uint64_t randomLowerBits() {
+		switch (std::rand() % 8) {
+			case 0:
+				return randomValue(64);
+			case 1:
+				return 65535 - randomValue(64);
+			default:
+				return randomValue(65536);
+		}
+	}
+
+	// Adds about count random indices of the chunk to the reference
+	void addChunk(Reference& reference, uint64_t key, size_t count) {
+		if (count == 65536) {
+			for (uint64_t i = 0; i < 65536; ++i)
+				reference.insert((key << 16) | i);
+			return;
+		}
+		for (size_t i = 0; i < count; ++i)
+			reference.insert((key << 16) | randomLowerBits());
+	}
+
+	// A reference of random indices in a few of the chunks
+	Reference makeReference() {
+		Reference reference;
+		for (size_t k = 0; k < NumChunkKeys; ++k) {
+			if (std::rand() % 2 == 0)
+				addChunk(reference, ChunkKeys[k], ChunkCounts[std::rand() % NumChunkCounts]);
+		}
+		return reference;
+	}
+
+	IndexSet makeSet(const Reference& reference) {
+		IndexSet set;
+		for (Reference::const_iterator it = reference.begin(); it != reference.end(); ++it)
+			set.insert(*it);
+		return set;
+	}
+
+	// Compares the set with the reference by iterating it, counting it and looking up the indices
+	// of the reference and their neighbours, and returns 1 if it differs
+	int compare(const IndexSet& set, const Reference& reference, const char* name) {
+		std::vector<uint64_t> indices;
+		for (IndexSet::const_iterator it = set.begin(); it != set.end(); ++it) {
+			indices.push_back(*it);
+			if (indices.size() > reference.size())
+				break;
+		}
+		const bool sameIndices = indices.size() == reference.size()
+			&& std::equal(indices.begin(), indices.end(), reference.begin());
+		if (!sameIndices || set.size() != reference.size() || set.empty() != reference.empty()) {
+			std::printf("%s: %d indices iterated and size %d (expected %d)\n", name,
+			            static_cast<int>(indices.size()), static_cast<int>(set.size()),
+			            static_cast<int>(reference.size()));
+			return 1;
+		}
+
+		int failures = 0;
+		for (Reference::const_iterator it = reference.begin(); it != reference.end() && failures < 10; ++it) {
+			const uint64_t index = *it;
+			const uint64_t neighbours[] = { index, index - 1, index + 1, index ^ 0x10000 };
+			for (size_t n = 0; n < sizeof(neighbours) / sizeof(neighbours[0]); ++n) {
+				const bool expected = reference.count(neighbours[n]) != 0;
+				if (set.contains(neighbours[n]) != expected) {
+					std::printf("%s: contains(%llu) is %d (expected %d)\n", name,
+					            static_cast<unsigned long long>(neighbours[n]), !expected, expected);
+					++failures;
+				}
+			}
+		}
+		return (failures > 0) ? 1 : 0;
+	}
+
+	Reference unionOf(const Reference& first, const Reference& second) {
+		Reference result;
+		std::set_union(first.begin(), first.end(), second.begin(), second.end(),
+		               std::inserter(result, result.end()));
+		return result;
+	}
+
+	Reference intersectionOf(const Reference& first, const Reference& second) {
+		Reference result;
+		std::set_intersection(first.begin(), first.end(), second.begin(), second.end(),
+		                      std::inserter(result, result.end()));
+		return result;
+	}
+
+	Reference differenceOf(const Reference& first, const Reference& second) {
+		Reference result;
+		std::set_difference(first.begin(), first.end(), second.begin(), second.end(),
+		                    std::inserter(result, result.end()));
+		return result;
+	}
+
+	// Inserts and erases random indices of the chunks of the set, sometimes enough of them to turn
+	// an array into a bitmap or back, in both the set and its reference
+	void mutate(IndexSet& set, Reference& reference) {
+		const uint64_t key = ChunkKeys[std::rand() % NumChunkKeys];
+		const size_t count = ChunkCounts[std::rand() % NumChunkCounts] / 2 + 1;
+		const bool inserting = std::rand() % 2 == 0;
+		for (size_t i = 0; i < count; ++i) {
+			const uint64_t index = (key << 16) | randomLowerBits();
+			if (inserting) {
+				set.insert(index);
+				reference.insert(index);
+			}
+			else {
+				set.erase(index);
+				reference.erase(index);
+			}
+		}
+	}
+
+	// Erases the indices of a chunk one by one down to a single one, in random order, so that a
+	// bitmap turns into an array on the way
+	int testErase() {
+		Reference reference;
+		addChunk(reference, 65536, 65536);
+		IndexSet set = makeSet(reference);
+		std::vector<uint64_t> indices(reference.begin(), reference.end());
+		for (size_t i = indices.size() - 1; i > 0; --i)
+			std::swap(indices[i], indices[randomValue(i + 1)]);
+
+		int failures = 0;
+		for (size_t i = 0; i + 1 < indices.size(); ++i) {
+			set.erase(indices[i]);
+			reference.erase(indices[i]);
+			// Erasing an index that isn't in the set doesn't change it
+			set.erase(indices[i]);
+			const size_t remaining = reference.size();
+			if (remaining == 4097 || remaining == 4096 || remaining == 4095 || remaining == 1)
+				failures += compare(set, reference, "erase");
+		}
+		set.erase(indices.back());
+		if (!set.empty() || set.begin() != set.end()) {
+			std::printf("erase: the set isn't empty after erasing all indices\n");
+			++failures;
+		}
+		return failures;
+	}
+
+	// Builds random sets and compares all operations on them with the reference
+	int testOperations() {
+		int failures = 0;
+		for (int i = 0; i < RandomSets; ++i) {
+			const Reference first = makeReference();
+			const Reference second = makeReference();
+			const IndexSet firstSet = makeSet(first);
+			const IndexSet secondSet = makeSet(second);
+			failures += compare(firstSet, first, "insert");
+
+			IndexSet result = firstSet;
+			result |= secondSet;
+			failures += compare(result, unionOf(first, second), "union");
+			failures += compare(firstSet, first, "union operand");
+			result &= secondSet;
+			failures += compare(result, second, "intersection of the union");
+
+			result = firstSet;
+			result &= secondSet;
+			failures += compare(result, intersectionOf(first, second), "intersection");
+			result = firstSet;
+			result -= secondSet;
+			failures += compare(result, differenceOf(first, second), "difference");
+			result -= result;
+			failures += compare(result, Reference(), "difference with itself");
+
+			// The operations on the set that was copied from the first one, once the copy has
+			// changed some of its chunks and shares the others
+			IndexSet changed = firstSet;
+			Reference changedReference = first;
+			mutate(changed, changedReference);
+			mutate(changed, changedReference);
+			failures += compare(changed, changedReference, "mutated copy");
+			failures += compare(firstSet, first, "original of the mutated copy");
+
+			result = changed;
+			result |= firstSet;
+			failures += compare(result, unionOf(changedReference, first), "union with a copy");
+			result = changed;
+			result &= firstSet;
+			failures += compare(result, intersectionOf(changedReference, first), "intersection with a copy");
+			result = changed;
+			result -= firstSet;
+			failures += compare(result, differenceOf(changedReference, first), "difference with a copy");
+
+			IndexSet added;
+			IndexSet removed;
+			changed.changesSince(firstSet, added, removed);
+			failures += compare(added, differenceOf(changedReference, first), "changesSince, added");
+			failures += compare(removed, differenceOf(first, changedReference), "changesSince, removed");
+			secondSet.changesSince(firstSet, added, removed);
+			failures += compare(added, differenceOf(second, first), "changesSince of another set, added");
+			failures += compare(removed, differenceOf(first, second), "changesSince of another set, removed");
+
+			// Equal sets compare equal however they were built
+			const IndexSet rebuilt = makeSet(changedReference);
+			if (!(rebuilt == changed) || (changed == firstSet) != (changedReference == first)) {
+				std::printf("equality: a rebuilt set compares %s\n", (rebuilt == changed) ? "equal" : "unequal");
+				++failures;
+			}
+
+			// Changing the set the copies were made of doesn't change them, and clearing it
+			// neither
+			IndexSet original = secondSet;
+			const IndexSet copy = original;
+			Reference originalReference = second;
+			mutate(original, originalReference);
+			failures += compare(original, originalReference, "mutated original");
+			failures += compare(copy, second, "copy of the mutated original");
+			original.clear();
+			failures += compare(copy, second, "copy of the cleared original");
+		}
+		return failures;
+	}
+}
+
+int main() {
+	std::srand(19);
+	int failures = testErase();
+	failures += testOperations();
+	if (failures > 0) {
+		std::printf("FAILED: %d sets differ from the reference\n", failures);
+		return 1;
+	}
+	std::printf("All index sets match the reference\n");
+	return 0;
+}
@@ -0,0 +1,13 @@
+# A standalone regression test of the index set; it doesn't need the rest of Voreen.
+# Build and run it from this directory with: qmake && make && ./tnm_indexset_test
+TEMPLATE = app
+TARGET = tnm_indexset_test
+CONFIG += console
+CONFIG -= qt app_bundle
+
+# The sources include the module's headers relative to the Voreen root
+INCLUDEPATH += $$PWD/../../..
+
+SOURCES += \
+    tnm_indexset_test.cpp \
+    ../src/tnm_indexset.cpp
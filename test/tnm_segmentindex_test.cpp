@@ -0,0 +1,196 @@
+// A regression test of the line segment index against an exhaustive search over all rows. The
+// values are chosen at random and on the edges of the bins, where the bucketing has to round, at
+// the ends of [-1,1] and not a number; the points are chosen at random, on the axes and on the
+// lines themselves. For every point, findNearest() must return a row whose line is exactly as
+// close as the closest line the search finds, or -1 if no line comes within the distance, and
+// the same has to hold after the axes were reordered with update(). The test returns a non-zero
+// exit code if any query differs from the reference
+
+#include "modules/tnm093/include/tnm_segmentindex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <math.h>
+#include <vector>
+
+using namespace voreen;
+
+namespace {
+	// The row counts that are tested; around the word size of the visibility bitmaps and larger
+	const size_t RowCounts[] = { 0, 1, 63, 64, 65, 1000, 5000 };
+	const size_t AxisCounts[] = { 1, 2, 3, 5 };
+
+	// The number of random points per table
+	const int RandomPoints = 300;
+
+	const float NotANumber = std::numeric_limits<float>::quiet_NaN();
+
+	float randomFloat(float minimum, float maximum) {
+		return minimum + static_cast<float>(std::rand()) / RAND_MAX * (maximum - minimum);
+	}
+
+	// The lower edge of the bin b
+	float binEdge(int b) {
+		return -1.f + b * 2.f / LineSegmentIndex::NumBins;
+	}
+
+	// A value of [-1,1]: mostly random, but also the ends, the edges of the bins, the floats
+	// right next to them, and not a number
+	float makeValue() {
+		const int b = std::rand() % (LineSegmentIndex::NumBins + 1);
+		switch (std::rand() % 10) {
+			case 0:
+				return (std::rand() % 2) ? -1.f : 1.f;
+			case 1:
+				return binEdge(b);
+			case 2:
+				return std::max(-1.f, nextafterf(binEdge(b), -2.f));
+			case 3:
+				return std::min(1.f, nextafterf(binEdge(b), 2.f));
+			case 4:
+				return NotANumber;
+			default:
+				return randomFloat(-1.f, 1.f);
+		}
+	}
+
+	// The height of the line of the row at the point, computed the way the index does
+	float lineHeight(const std::vector<const float*>& columns, size_t row, float x) {
+		const size_t nGaps = columns.size() - 1;
+		const float position = (x + 1.f) * 0.5f * nGaps;
+		const size_t g = std::min(static_cast<size_t>(position), nGaps - 1);
+		const float t = position - g;
+		return (1.f - t) * columns[g][row] + t * columns[g + 1][row];
+	}
+
+	bool isVisible(const std::vector<uint64_t>& visible, size_t row) {
+		return visible.empty() || (visible[row / 64] & (uint64_t(1) << (row % 64))) != 0;
+	}
+
+	// Queries the point and compares the row with an exhaustive search; returns 1 if it differs
+	int testPoint(const LineSegmentIndex& index, const std::vector<const float*>& columns, size_t nRows,
+	              const tgt::vec2& point, float maxDistance, const std::vector<uint64_t>& visible, const char* name)
+	{
+		const long row = index.findNearest(point, maxDistance, visible);
+
+		// The distance to the closest visible line, if any line comes within maxDistance
+		bool inside = columns.size() > 1 && point.x >= -1.f && point.x <= 1.f;
+		float nearestDistance = std::numeric_limits<float>::max();
+		long nearest = -1;
+		for (size_t r = 0; inside && r < nRows; ++r) {
+			if (!isVisible(visible, r))
+				continue;
+			const float distance = std::abs(lineHeight(columns, r, point.x) - point.y);
+			if (distance <= maxDistance && distance < nearestDistance) {
+				nearest = static_cast<long>(r);
+				nearestDistance = distance;
+			}
+		}
+
+		bool matches = (row == -1) == (nearest == -1);
+		if (matches && row != -1) {
+			const size_t r = static_cast<size_t>(row);
+			matches = r < nRows && isVisible(visible, r)
+				&& std::abs(lineHeight(columns, r, point.x) - point.y) == nearestDistance;
+		}
+		if (!matches) {
+			std::printf("%s, %d rows, %d axes, point (%.9g, %.9g), distance %g: row %ld (expected row %ld at %.9g)\n",
+			            name, static_cast<int>(nRows), static_cast<int>(columns.size()), point.x, point.y,
+			            maxDistance, row, nearest, nearestDistance);
+			return 1;
+		}
+		return 0;
+	}
+
+	// A point at random, on an axis, or on the line of a random row
+	tgt::vec2 makePoint(const std::vector<const float*>& columns, size_t nRows) {
+		const size_t nGaps = columns.size() - 1;
+		tgt::vec2 point(randomFloat(-1.1f, 1.1f), randomFloat(-1.1f, 1.1f));
+		switch (std::rand() % 4) {
+			case 0:
+				point.x = -1.f + 2.f * (std::rand() % (nGaps + 1)) / std::max(nGaps, size_t(1));
+				break;
+			case 1:
+				point.x = randomFloat(-1.f, 1.f);
+				if (nRows > 0 && nGaps > 0) {
+					point.y = lineHeight(columns, std::rand() % nRows, point.x);
+					if (point.y != point.y)
+						point.y = 0.f;
+				}
+				break;
+			default:
+				break;
+		}
+		return point;
+	}
+
+	int testQueries(const LineSegmentIndex& index, const std::vector<const float*>& columns, size_t nRows,
+	                const char* name)
+	{
+		const float MaxDistances[] = { 0.f, 0.001f, 2.f / LineSegmentIndex::NumBins, 0.1f, 3.f };
+		const size_t nDistances = sizeof(MaxDistances) / sizeof(MaxDistances[0]);
+
+		// All rows, a random half of them, and none
+		std::vector<uint64_t> halfVisible((nRows + 63) / 64, 0);
+		std::vector<uint64_t> noneVisible(std::max(halfVisible.size(), size_t(1)), 0);
+		for (size_t r = 0; r < nRows; ++r) {
+			if (std::rand() % 2)
+				halfVisible[r / 64] |= uint64_t(1) << (r % 64);
+		}
+		const std::vector<uint64_t> allVisible;
+
+		int failures = 0;
+		for (int i = 0; i < RandomPoints; ++i) {
+			const tgt::vec2 point = makePoint(columns, nRows);
+			const float maxDistance = MaxDistances[i % nDistances];
+			failures += testPoint(index, columns, nRows, point, maxDistance, allVisible, name);
+			if (nRows > 0) {
+				failures += testPoint(index, columns, nRows, point, maxDistance, halfVisible, name);
+				failures += testPoint(index, columns, nRows, point, maxDistance, noneVisible, name);
+			}
+		}
+		return failures;
+	}
+
+	int testTable(size_t nRows, size_t nAxes) {
+		std::vector<std::vector<float> > values(nAxes, std::vector<float>(nRows));
+		std::vector<const float*> columns(nAxes);
+		for (size_t a = 0; a < nAxes; ++a) {
+			for (size_t r = 0; r < nRows; ++r)
+				values[a][r] = makeValue();
+			columns[a] = values[a].empty() ? 0 : &values[a][0];
+		}
+
+		LineSegmentIndex index;
+		index.build(columns, nRows);
+		int failures = testQueries(index, columns, nRows, "build");
+
+		// Moving an axis keeps some of the gaps and indexes the others again
+		if (nAxes > 1) {
+			std::rotate(columns.begin(), columns.begin() + 1, columns.end());
+			index.update(columns, nRows);
+			failures += testQueries(index, columns, nRows, "update");
+			std::swap(columns.front(), columns.back());
+			index.update(columns, nRows);
+			failures += testQueries(index, columns, nRows, "second update");
+		}
+		return failures;
+	}
+}
+
+int main() {
+	std::srand(22);
+	int failures = 0;
+	for (size_t i = 0; i < sizeof(RowCounts) / sizeof(RowCounts[0]); ++i)
+		for (size_t a = 0; a < sizeof(AxisCounts) / sizeof(AxisCounts[0]); ++a)
+			failures += testTable(RowCounts[i], AxisCounts[a]);
+	if (failures > 0) {
+		std::printf("FAILED: %d queries differ from the reference\n", failures);
+		return 1;
+	}
+	std::printf("All queries of the line segment index match the reference\n");
+	return 0;
+}
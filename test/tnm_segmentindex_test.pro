@@ -0,0 +1,13 @@
+# A standalone regression test of the line segment index; it doesn't need the rest of Voreen.
+# Build and run it from this directory with: qmake && make && ./tnm_segmentindex_test
+TEMPLATE = app
+TARGET = tnm_segmentindex_test
+CONFIG += console
+CONFIG -= qt app_bundle
+
+# The sources include the module's headers relative to the Voreen root, and tgt from ext
+INCLUDEPATH += $$PWD/../../.. $$PWD/../../../ext
+
+SOURCES += \
+    tnm_segmentindex_test.cpp \
+    ../src/tnm_segmentindex.cpp
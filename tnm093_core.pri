@@ -1,16 +1,46 @@
 SOURCES += \
     $${VRN_MODULE_DIR}/tnm093/src/indexproperty.cpp \
+    $${VRN_MODULE_DIR}/tnm093/src/tnm_bitmapindex.cpp \
     $${VRN_MODULE_DIR}/tnm093/src/tnm_datareduction.cpp \
+    $${VRN_MODULE_DIR}/tnm093/src/tnm_datatofeaturetable.cpp \
+    $${VRN_MODULE_DIR}/tnm093/src/tnm_featurefile.cpp \
+    $${VRN_MODULE_DIR}/tnm093/src/tnm_featurekernels.cpp \
+    $${VRN_MODULE_DIR}/tnm093/src/tnm_featurepyramid.cpp \
+    $${VRN_MODULE_DIR}/tnm093/src/tnm_featureregistry.cpp \
+    $${VRN_MODULE_DIR}/tnm093/src/tnm_featuretable.cpp \
+    $${VRN_MODULE_DIR}/tnm093/src/tnm_featuretabletodata.cpp \
+    $${VRN_MODULE_DIR}/tnm093/src/tnm_indexset.cpp \
     $${VRN_MODULE_DIR}/tnm093/src/tnm_parallelcoordinates.cpp \
     $${VRN_MODULE_DIR}/tnm093/src/tnm_raycaster.cpp \
     $${VRN_MODULE_DIR}/tnm093/src/tnm_scatterplot.cpp \
+    $${VRN_MODULE_DIR}/tnm093/src/tnm_segmentindex.cpp \
     $${VRN_MODULE_DIR}/tnm093/src/tnm_volumeinformation.cpp
 
 HEADERS += \
     $${VRN_MODULE_DIR}/tnm093/include/indexproperty.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_bitmapindex.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_bits.h \
     $${VRN_MODULE_DIR}/tnm093/include/tnm_datareduction.h \
     $${VRN_MODULE_DIR}/tnm093/include/tnm_common.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_datatofeaturetable.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_featurefile.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_featurekernels.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_featurepyramid.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_featureregistry.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_featuretable.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_featuretabletodata.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_indexset.h \
     $${VRN_MODULE_DIR}/tnm093/include/tnm_parallelcoordinates.h \
     $${VRN_MODULE_DIR}/tnm093/include/tnm_raycaster.h \
     $${VRN_MODULE_DIR}/tnm093/include/tnm_scatter.h \
+    $${VRN_MODULE_DIR}/tnm093/include/tnm_segmentindex.h \
     $${VRN_MODULE_DIR}/tnm093/include/tnm_volumeinformation.h
+
+# the feature extraction in TNMVolumeInformation is parallelized using OpenMP
+unix {
+    QMAKE_CXXFLAGS += -fopenmp
+    QMAKE_LFLAGS += -fopenmp
+}
+win32 {
+    QMAKE_CXXFLAGS += /openmp
+}
@@ -29,6 +29,8 @@
 #include "modules/tnm093/tnm093module.h"
 
 #include "modules/tnm093/include/tnm_datareduction.h"
+#include "modules/tnm093/include/tnm_datatofeaturetable.h"
+#include "modules/tnm093/include/tnm_featuretabletodata.h"
 #include "modules/tnm093/include/tnm_parallelcoordinates.h"
 #include "modules/tnm093/include/tnm_raycaster.h"
 #include "modules/tnm093/include/tnm_scatterplot.h"
@@ -44,6 +46,8 @@ TNM093Module::TNM093Module()
     addShaderPath(getModulesPath("tnm093/glsl"));
 
     addProcessor(new TNMDataReduction);
+    addProcessor(new TNMDataToFeatureTable);
+    addProcessor(new TNMFeatureTableToData);
     addProcessor(new TNMParallelCoordinates);
     addProcessor(new TNMRaycaster);
     addProcessor(new TNMScatterPlot);